@@ -0,0 +1,251 @@
+﻿#pragma once
+#include "SceneMaster.hpp"
+#include <chrono>
+
+namespace Utility {
+    /// <summary>
+    /// マイクロベンチマークの計測と結果の書き出し
+    /// </summary>
+    /// <remarks>
+    /// 1回の計測が minTime 以上になるよう反復回数を決め、repetitions 回計測した中央値を結果とします。
+    /// </remarks>
+    class Benchmark {
+    public:
+        struct Result {
+            s3d::String name;
+
+            s3d::uint64 iterations;
+
+            // 1回あたりの時間（ナノ秒）
+            double medianNs;
+
+            double minNs;
+
+            double maxNs;
+        };
+
+    private:
+        s3d::int32 m_repetitions;
+
+        double m_minTimeSec;
+
+        s3d::Array<Result> m_results;
+
+        using Clock = std::chrono::steady_clock;
+
+        template<class Function>
+        [[nodiscard]] static double Measure(Function& function, const s3d::uint64 iterations) {
+            const auto start = Clock::now();
+
+            for (s3d::uint64 i = 0; i < iterations; ++i) {
+                function();
+            }
+
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+    public:
+        /// <param name="repetitions">
+        /// 計測を繰り返す回数
+        /// </param>
+        /// <param name="minTime">
+        /// 1回の計測にかける最低限の時間
+        /// </param>
+        explicit Benchmark(s3d::int32 repetitions = 15, const s3d::Duration& minTime = s3d::MillisecondsF(20))
+            : m_repetitions(repetitions), m_minTimeSec(minTime.count()) {}
+
+        /// <summary>
+        /// 最適化で計算が消されないようにします。
+        /// </summary>
+        template<class Type>
+        static void DoNotOptimize(const Type& value) {
+            static volatile const void* sink;
+            sink = &value;
+        }
+
+        /// <summary>
+        /// 関数の1回あたりの時間を計測します。
+        /// </summary>
+        /// <param name="name">
+        /// 結果の名前
+        /// </param>
+        /// <param name="function">
+        /// 計測する関数
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        template<class Function>
+        Benchmark& run(const s3d::String& name, Function function) {
+            // 反復回数を決める（キャッシュを温める意味もある）
+            s3d::uint64 iterations = 1;
+
+            while (Measure(function, iterations) < m_minTimeSec && iterations < (1ull << 40)) {
+                iterations *= 2;
+            }
+
+            s3d::Array<double> times(m_repetitions);
+
+            for (auto& time : times) {
+                time = Measure(function, iterations) * 1e9 / iterations;
+            }
+
+            times.sort();
+
+            m_results.push_back({ name, iterations, times[times.size() / 2], times.front(), times.back() });
+
+            return *this;
+        }
+
+        [[nodiscard]] const s3d::Array<Result>& getResults() const noexcept {
+            return m_results;
+        }
+
+        /// <summary>
+        /// 結果を JSON で書き出します。
+        /// </summary>
+        /// <param name="path">
+        /// 書き出すファイル
+        /// </param>
+        /// <returns>
+        /// 書き出せた場合 true, それ以外の場合は false
+        /// </returns>
+        bool writeJSON(const s3d::FilePath& path) const {
+            s3d::TextWriter writer(path);
+
+            if (!writer) {
+                return false;
+            }
+
+            writer.writeln(U"{");
+            writer.writeln(U"  \"repetitions\": ", m_repetitions, U',');
+            writer.writeln(U"  \"benchmarks\": [");
+
+            for (size_t i = 0; i < m_results.size(); ++i) {
+                const Result& result = m_results[i];
+
+                writer.writeln(U"    { \"name\": \"", result.name, U"\", \"iterations\": ", result.iterations,
+                               U", \"median_ns\": ", s3d::ToString(result.medianNs, 2),
+                               U", \"min_ns\": ", s3d::ToString(result.minNs, 2),
+                               U", \"max_ns\": ", s3d::ToString(result.maxNs, 2),
+                               (i + 1 < m_results.size()) ? U" }," : U" }");
+            }
+
+            writer.writeln(U"  ]");
+            writer.writeln(U"}");
+
+            return true;
+        }
+    };
+
+    namespace detail {
+        /// <summary>
+        /// 計測用の何もしないシーン
+        /// </summary>
+        template<class State, class Data>
+        class BenchmarkScene : public IScene<State, Data> {
+        public:
+            using typename IScene<State, Data>::InitData;
+
+            explicit BenchmarkScene(const InitData& init) : IScene<State, Data>(init) {
+                this->registerEventHandler(2, [](int playerNr, const ExitGames::Common::Object&) { Benchmark::DoNotOptimize(playerNr); });
+            }
+
+            void CustomEventAction(int playerNr, nByte, const ExitGames::Common::Object&) override {
+                Benchmark::DoNotOptimize(playerNr);
+            }
+        };
+    }  // namespace detail
+
+    /// <summary>
+    /// Utility の処理にかかる時間を計測し、結果を JSON で書き出します。
+    /// </summary>
+    /// <remarks>
+    /// 通信は行いません。Data の初期化にかかる時間も計測します。
+    /// </remarks>
+    /// <param name="first">
+    /// 計測に使うシーンのキー
+    /// </param>
+    /// <param name="second">
+    /// 計測に使う、first とは別のシーンのキー
+    /// </param>
+    /// <param name="path">
+    /// 結果を書き出すファイル
+    /// </param>
+    /// <returns>
+    /// 計測結果
+    /// </returns>
+    template<class State, class Data>
+    Benchmark RunBenchmarks(const State& first, const State& second, const s3d::FilePath& path) {
+        using Scene = detail::BenchmarkScene<State, Data>;
+
+        Benchmark benchmark;
+
+        SceneMaster<State, Data> manager(L"", L"1.0");
+
+        manager.template add<Scene>(first).template add<Scene>(second);
+
+        manager.init(first);
+
+        manager.updateScene();
+
+        benchmark.run(U"SceneMaster::changeScene", [&, next = false]() mutable {
+            next = !next;
+            Benchmark::DoNotOptimize(manager.changeScene(next ? second : first, 0, false));
+        });
+
+        // フェードの時間を 0 にして、シーンの破棄と生成を含む遷移を1回の updateScene() で終わらせる
+        benchmark.run(U"SceneMaster::transitionCycle", [&, next = false]() mutable {
+            next = !next;
+            manager.changeScene(next ? second : first, 0, false);
+            Benchmark::DoNotOptimize(manager.updateScene());
+        });
+
+        benchmark.run(U"SceneMaster::add", [&]() {
+            manager.template add<Scene>(second);
+        });
+
+        // ファクトリの呼び出し（アリーナとシーンの生成と破棄）
+        benchmark.run(U"SceneMaster::factory", [&]() {
+            Benchmark::DoNotOptimize(manager.createScene(second));
+        });
+
+        {
+            ExitGames::LoadBalancing::Listener& listener = manager;
+
+            const ExitGames::Common::Object content = ExitGames::Common::ValueObject<int>(42);
+
+            // イベントコード 1 は CustomEventAction、2 は登録したハンドラで受け取る
+            benchmark.run(U"Listener::customEventAction/virtual", [&]() {
+                listener.customEventAction(1, 1, content);
+            });
+
+            benchmark.run(U"Listener::customEventAction/handler", [&]() {
+                listener.customEventAction(1, 2, content);
+            });
+        }
+
+        for (const size_t length : { 8, 64, 512 }) {
+            const s3d::String string(length, U'あ');
+
+            const ExitGames::Common::JString jstring = ConvertStringToJString(string);
+
+            benchmark.run(s3d::Format(U"ConvertStringToJString/", length), [&]() {
+                Benchmark::DoNotOptimize(ConvertStringToJString(string));
+            });
+
+            benchmark.run(s3d::Format(U"ConvertJStringToString/", length), [&]() {
+                Benchmark::DoNotOptimize(ConvertJStringToString(jstring));
+            });
+        }
+
+        benchmark.run(U"Data::Data", []() {
+            Data data;
+            Benchmark::DoNotOptimize(data);
+        });
+
+        benchmark.writeJSON(path);
+
+        return benchmark;
+    }
+}  // namespace Utility
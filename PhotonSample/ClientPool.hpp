@@ -0,0 +1,637 @@
+﻿#pragma once
+#define NO_S3D_USING
+#include <Siv3D.hpp>  // OpenSiv3D v0.4.3
+#include <LoadBalancing-cpp/inc/Client.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace Utility {
+    template<class Session>
+    class ClientPool;
+
+    /// <summary>
+    /// ClientPool で動かす1クライアント分のセッション
+    /// </summary>
+    /// <remarks>
+    /// コールバックは IScene と同じ名前の仮想関数で受け取ります。
+    /// 同じセッションが同時に複数のスレッドから呼ばれることはありません。
+    /// </remarks>
+    class ClientSession : s3d::Uncopyable {
+    private:
+        template<class Session>
+        friend class ClientPool;
+
+        ExitGames::LoadBalancing::Client* m_client = nullptr;
+
+        std::atomic<bool> m_finished{ false };
+
+    public:
+        virtual ~ClientSession() = default;
+
+        virtual void DebugReturn(int /*debugLevel*/, const ExitGames::Common::JString& /*string*/) {}
+
+        virtual void ConnectionErrorReturn(int /*errorCode*/) {}
+
+        virtual void ClientErrorReturn(int /*errorCode*/) {}
+
+        virtual void WarningReturn(int /*warningCode*/) {}
+
+        virtual void ServerErrorReturn(int /*errorCode*/) {}
+
+        virtual void JoinRoomEventAction(int /*playerNr*/, const ExitGames::Common::JVector<int>& /*playernrs*/, const ExitGames::LoadBalancing::Player& /*player*/) {}
+
+        virtual void LeaveRoomEventAction(int /*playerNr*/, bool /*isInactive*/) {}
+
+        virtual void CustomEventAction(int /*playerNr*/, nByte /*eventCode*/, const ExitGames::Common::Object& /*eventContent*/) {}
+
+        virtual void ConnectReturn(int /*errorCode*/,
+                                   const ExitGames::Common::JString& /*errorString*/,
+                                   const ExitGames::Common::JString& /*region*/,
+                                   const ExitGames::Common::JString& /*cluster*/) {}
+
+        virtual void DisconnectReturn() {}
+
+        virtual void LeaveRoomReturn(int /*errorCode*/, const ExitGames::Common::JString& /*errorString*/) {}
+
+        virtual void CreateRoomReturn(int /*localPlayerNr*/,
+                                      const ExitGames::Common::Hashtable& /*roomProperties*/,
+                                      const ExitGames::Common::Hashtable& /*playerProperties*/,
+                                      int /*errorCode*/,
+                                      const ExitGames::Common::JString& /*errorString*/) {}
+
+        virtual void JoinRandomRoomReturn(int /*localPlayerNr*/,
+                                          const ExitGames::Common::Hashtable& /*roomProperties*/,
+                                          const ExitGames::Common::Hashtable& /*playerProperties*/,
+                                          int /*errorCode*/,
+                                          const ExitGames::Common::JString& /*errorString*/) {}
+
+        virtual void JoinRoomReturn(int /*localPlayerNr*/,
+                                    const ExitGames::Common::Hashtable& /*roomProperties*/,
+                                    const ExitGames::Common::Hashtable& /*playerProperties*/,
+                                    int /*errorCode*/,
+                                    const ExitGames::Common::JString& /*errorString*/) {}
+
+        /// <summary>
+        /// プールに追加された直後に、ワーカースレッドで一度だけ呼ばれる
+        /// </summary>
+        virtual void Start() {}
+
+        /// <summary>
+        /// 毎ティック service() の前に呼ばれる
+        /// </summary>
+        virtual void UpdatePhoton() {}
+
+        ExitGames::LoadBalancing::Client& GetClient() {
+            return *m_client;
+        }
+
+        /// <summary>
+        /// セッションの終了を通知します。次のティックでプールから取り除かれます。
+        /// </summary>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void finish() noexcept {
+            m_finished = true;
+        }
+
+        [[nodiscard]] bool isFinished() const noexcept {
+            return m_finished;
+        }
+    };
+
+    /// <summary>
+    /// ClientPool の処理量
+    /// </summary>
+    struct ClientPoolStats {
+        size_t sessions = 0;
+
+        size_t workers = 0;
+
+        // 計測開始からのティック数と service() の回数
+        s3d::uint64 ticks = 0;
+
+        s3d::uint64 services = 0;
+
+        double ticksPerSecond = 0.0;
+
+        // 1ワーカー(1コア)あたりの 1秒間の service() の回数 (セッション数 × ティック/秒 ÷ ワーカー数)
+        double servicesPerSecondPerWorker = 0.0;
+
+        // 予定の間隔に間に合わなかったティックの数
+        s3d::uint64 overruns = 0;
+    };
+
+    namespace detail {
+        /// <summary>
+        /// Photon のコールバックをセッションに渡す
+        /// </summary>
+        class SessionListener : public ExitGames::LoadBalancing::Listener {
+        private:
+            ClientSession& m_session;
+
+        public:
+            explicit SessionListener(ClientSession& session) : m_session(session) {}
+
+        private:
+            virtual void debugReturn(int debugLevel, const ExitGames::Common::JString& string) override {
+                m_session.DebugReturn(debugLevel, string);
+            }
+
+            virtual void connectionErrorReturn(int errorCode) override {
+                m_session.ConnectionErrorReturn(errorCode);
+            }
+
+            virtual void clientErrorReturn(int errorCode) override {
+                m_session.ClientErrorReturn(errorCode);
+            }
+
+            virtual void warningReturn(int warningCode) override {
+                m_session.WarningReturn(warningCode);
+            }
+
+            virtual void serverErrorReturn(int errorCode) override {
+                m_session.ServerErrorReturn(errorCode);
+            }
+
+            virtual void joinRoomEventAction(int playerNr, const ExitGames::Common::JVector<int>& playernrs, const ExitGames::LoadBalancing::Player& player) override {
+                m_session.JoinRoomEventAction(playerNr, playernrs, player);
+            }
+
+            virtual void leaveRoomEventAction(int playerNr, bool isInactive) override {
+                m_session.LeaveRoomEventAction(playerNr, isInactive);
+            }
+
+            virtual void customEventAction(int playerNr, nByte eventCode, const ExitGames::Common::Object& eventContent) override {
+                m_session.CustomEventAction(playerNr, eventCode, eventContent);
+            }
+
+            virtual void connectReturn(int errorCode,
+                                       const ExitGames::Common::JString& errorString,
+                                       const ExitGames::Common::JString& region,
+                                       const ExitGames::Common::JString& cluster) override {
+                m_session.ConnectReturn(errorCode, errorString, region, cluster);
+            }
+
+            virtual void disconnectReturn() override {
+                m_session.DisconnectReturn();
+            }
+
+            virtual void leaveRoomReturn(int errorCode, const ExitGames::Common::JString& errorString) override {
+                m_session.LeaveRoomReturn(errorCode, errorString);
+            }
+
+            virtual void createRoomReturn(int localPlayerNr,
+                                          const ExitGames::Common::Hashtable& roomProperties,
+                                          const ExitGames::Common::Hashtable& playerProperties,
+                                          int errorCode,
+                                          const ExitGames::Common::JString& errorString) override {
+                m_session.CreateRoomReturn(localPlayerNr, roomProperties, playerProperties, errorCode, errorString);
+            }
+
+            virtual void joinRandomRoomReturn(int localPlayerNr,
+                                              const ExitGames::Common::Hashtable& roomProperties,
+                                              const ExitGames::Common::Hashtable& playerProperties,
+                                              int errorCode,
+                                              const ExitGames::Common::JString& errorString) override {
+                m_session.JoinRandomRoomReturn(localPlayerNr, roomProperties, playerProperties, errorCode, errorString);
+            }
+
+            virtual void joinRoomReturn(int localPlayerNr,
+                                        const ExitGames::Common::Hashtable& roomProperties,
+                                        const ExitGames::Common::Hashtable& playerProperties,
+                                        int errorCode,
+                                        const ExitGames::Common::JString& errorString) override {
+                m_session.JoinRoomReturn(localPlayerNr, roomProperties, playerProperties, errorCode, errorString);
+            }
+        };
+    }  // namespace detail
+
+    /// <summary>
+    /// 多数のクライアントを1つのプロセスで動かす
+    /// </summary>
+    /// <remarks>
+    /// セッションは一定間隔のティックごとに1回ずつ service() されます。
+    /// 各ティックでセッションをワーカーに均等に配り、自分の分が終わったワーカーは他のワーカーの分を引き受けます。
+    /// Session には ClientSession の派生クラスを指定します。
+    /// </remarks>
+    template<class Session>
+    class ClientPool : s3d::Uncopyable {
+    private:
+        struct Slot {
+            std::unique_ptr<Session> session;
+
+            detail::SessionListener listener;
+
+            ExitGames::LoadBalancing::Client client;
+
+            bool started = false;
+
+            Slot(std::unique_ptr<Session>&& session_, const ExitGames::Common::JString& appID, const ExitGames::Common::JString& appVersion)
+                : session(std::move(session_)), listener(*session), client(listener, appID, appVersion) {}
+        };
+
+        struct Worker {
+            std::mutex mutex;
+
+            std::deque<Slot*> queue;
+
+            std::thread thread;
+        };
+
+        ExitGames::Common::JString m_appID;
+
+        ExitGames::Common::JString m_appVersion;
+
+        std::chrono::nanoseconds m_tickInterval;
+
+        // 追加待ちのセッション（どのスレッドからでも追加できる）
+        std::mutex m_pendingMutex;
+
+        s3d::Array<std::unique_ptr<Slot>> m_pending;
+
+        // スケジューラのスレッドだけが触る
+        s3d::Array<std::unique_ptr<Slot>> m_slots;
+
+        size_t m_rotation = 0;
+
+        std::vector<std::unique_ptr<Worker>> m_workers;
+
+        std::thread m_scheduler;
+
+        std::atomic<bool> m_running{ false };
+
+        // ティックの開始と終了の通知
+        std::mutex m_tickMutex;
+
+        std::condition_variable m_tickStarted;
+
+        std::condition_variable m_tickFinished;
+
+        s3d::uint64 m_epoch = 0;
+
+        size_t m_busyWorkers = 0;
+
+        // スケジューラが止まった後にワーカーを止める
+        bool m_stopWorkers = false;
+
+        // 統計
+        std::atomic<size_t> m_sessionCount{ 0 };
+
+        std::atomic<s3d::uint64> m_ticks{ 0 };
+
+        std::atomic<s3d::uint64> m_services{ 0 };
+
+        std::atomic<s3d::uint64> m_overruns{ 0 };
+
+        std::chrono::steady_clock::time_point m_startTime;
+
+        static void ServiceSlot(Slot& slot) {
+            if (!slot.started) {
+                slot.started = true;
+
+                slot.session->Start();
+            }
+
+            slot.session->UpdatePhoton();
+
+            slot.client.service();
+        }
+
+        /// <summary>
+        /// 自分のキューから先頭を、空なら他のワーカーのキューから末尾を取り出す
+        /// </summary>
+        [[nodiscard]] Slot* takeWork(const size_t index) {
+            {
+                Worker& self = *m_workers[index];
+
+                std::lock_guard lock(self.mutex);
+
+                if (!self.queue.empty()) {
+                    Slot* slot = self.queue.front();
+                    self.queue.pop_front();
+                    return slot;
+                }
+            }
+
+            for (size_t i = 1; i < m_workers.size(); ++i) {
+                Worker& victim = *m_workers[(index + i) % m_workers.size()];
+
+                std::lock_guard lock(victim.mutex);
+
+                if (!victim.queue.empty()) {
+                    Slot* slot = victim.queue.back();
+                    victim.queue.pop_back();
+                    return slot;
+                }
+            }
+
+            return nullptr;
+        }
+
+        void workerLoop(const size_t index) {
+            s3d::uint64 epoch = 0;
+
+            for (;;) {
+                {
+                    std::unique_lock lock(m_tickMutex);
+
+                    m_tickStarted.wait(lock, [&] { return m_epoch != epoch || m_stopWorkers; });
+
+                    if (m_epoch == epoch) {
+                        return;
+                    }
+
+                    epoch = m_epoch;
+                }
+
+                s3d::uint64 serviced = 0;
+
+                while (Slot* slot = takeWork(index)) {
+                    ServiceSlot(*slot);
+
+                    ++serviced;
+                }
+
+                m_services += serviced;
+
+                {
+                    std::lock_guard lock(m_tickMutex);
+
+                    if (--m_busyWorkers == 0) {
+                        m_tickFinished.notify_one();
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// 終了したセッションを取り除き、追加待ちのセッションを取り込む
+        /// </summary>
+        void collectSessions() {
+            m_slots.remove_if([](const std::unique_ptr<Slot>& slot) {
+                if (!slot->session->isFinished()) {
+                    return false;
+                }
+
+                // 切断を送ってから破棄し、サーバーに接続を残さない
+                slot->client.disconnect();
+                slot->client.sendOutgoingCommands();
+
+                return true;
+            });
+
+            {
+                std::lock_guard lock(m_pendingMutex);
+
+                for (auto& slot : m_pending) {
+                    m_slots.push_back(std::move(slot));
+                }
+
+                m_pending.clear();
+            }
+
+            m_sessionCount = m_slots.size();
+        }
+
+        /// <summary>
+        /// セッションをワーカーに配る。毎ティック配り始めるセッションをずらし、同じセッションが常にキューの後ろにならないようにする
+        /// </summary>
+        void distribute() {
+            const size_t workers = m_workers.size();
+
+            const size_t sessions = m_slots.size();
+
+            if (sessions == 0) {
+                return;
+            }
+
+            const size_t offset = m_rotation % sessions;
+
+            for (size_t i = 0; i < sessions; ++i) {
+                Worker& worker = *m_workers[i % workers];
+
+                std::lock_guard lock(worker.mutex);
+
+                worker.queue.push_back(m_slots[(offset + i) % sessions].get());
+            }
+
+            m_rotation = offset + 1;
+        }
+
+        void schedulerLoop() {
+            auto next = std::chrono::steady_clock::now();
+
+            while (m_running) {
+                collectSessions();
+
+                distribute();
+
+                {
+                    std::unique_lock lock(m_tickMutex);
+
+                    m_busyWorkers = m_workers.size();
+
+                    ++m_epoch;
+
+                    m_tickStarted.notify_all();
+
+                    m_tickFinished.wait(lock, [&] { return m_busyWorkers == 0; });
+                }
+
+                ++m_ticks;
+
+                next += m_tickInterval;
+
+                const auto now = std::chrono::steady_clock::now();
+
+                if (now > next) {
+                    // 間に合わなかった分は詰めずに、次のティックから数え直す
+                    ++m_overruns;
+
+                    next = now;
+                }
+                else {
+                    std::this_thread::sleep_until(next);
+                }
+            }
+        }
+
+    public:
+        /// <summary>
+        /// クライアントのプールを初期化します。
+        /// </summary>
+        /// <param name="appID_">
+        /// Photon の appID
+        /// </param>
+        /// <param name="appVersion_">
+        /// アプリのバージョン
+        /// </param>
+        /// <param name="ticksPerSecond">
+        /// 1秒間に各セッションを service() する回数
+        /// </param>
+        ClientPool(const ExitGames::Common::JString& appID_, const ExitGames::Common::JString& appVersion_, double ticksPerSecond = 30.0)
+            : m_appID(appID_),
+              m_appVersion(appVersion_),
+              m_tickInterval(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(1.0 / ticksPerSecond))) {}
+
+        ~ClientPool() {
+            stop();
+        }
+
+        /// <summary>
+        /// セッションを追加します。実行中でも追加でき、次のティックから service() されます。
+        /// </summary>
+        /// <param name="args">
+        /// Session のコンストラクタに渡す引数
+        /// </param>
+        /// <returns>
+        /// 追加したセッション
+        /// </returns>
+        template<class... Args>
+        Session& add(Args&&... args) {
+            auto slot = std::make_unique<Slot>(std::make_unique<Session>(std::forward<Args>(args)...), m_appID, m_appVersion);
+
+            Session& session = *slot->session;
+
+            session.m_client = &slot->client;
+
+            std::lock_guard lock(m_pendingMutex);
+
+            m_pending.push_back(std::move(slot));
+
+            return session;
+        }
+
+        /// <summary>
+        /// ワーカースレッドを起動して service() を始めます。
+        /// </summary>
+        /// <param name="workers">
+        /// ワーカースレッドの数（0 の場合は論理コア数）
+        /// </param>
+        /// <returns>
+        /// 起動した場合 true, 既に実行中の場合は false
+        /// </returns>
+        bool start(size_t workers = 0) {
+            if (m_running) {
+                return false;
+            }
+
+            if (workers == 0) {
+                workers = s3d::Max<size_t>(std::thread::hardware_concurrency(), 1);
+            }
+
+            m_running = true;
+
+            m_stopWorkers = false;
+
+            m_epoch = 0;
+
+            m_ticks = 0;
+
+            m_services = 0;
+
+            m_overruns = 0;
+
+            m_startTime = std::chrono::steady_clock::now();
+
+            for (size_t i = 0; i < workers; ++i) {
+                m_workers.push_back(std::make_unique<Worker>());
+            }
+
+            for (size_t i = 0; i < workers; ++i) {
+                m_workers[i]->thread = std::thread(&ClientPool::workerLoop, this, i);
+            }
+
+            m_scheduler = std::thread(&ClientPool::schedulerLoop, this);
+
+            return true;
+        }
+
+        /// <summary>
+        /// 実行中のティックが終わるのを待って全てのスレッドを止め、全てのセッションを切断して取り除きます。
+        /// </summary>
+        /// <remarks>
+        /// add() で受け取ったセッションの参照は使えなくなります。
+        /// </remarks>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void stop() {
+            if (!m_running) {
+                return;
+            }
+
+            m_running = false;
+
+            m_scheduler.join();
+
+            {
+                std::lock_guard lock(m_tickMutex);
+
+                m_stopWorkers = true;
+
+                m_tickStarted.notify_all();
+            }
+
+            for (auto& worker : m_workers) {
+                worker->thread.join();
+            }
+
+            m_workers.clear();
+
+            // 接続したままクライアントを破棄しないよう、切断を送ってから取り除く
+            for (auto& slot : m_slots) {
+                slot->client.disconnect();
+                slot->client.sendOutgoingCommands();
+            }
+
+            m_slots.clear();
+
+            {
+                std::lock_guard lock(m_pendingMutex);
+
+                m_pending.clear();
+            }
+
+            m_sessionCount = 0;
+        }
+
+        [[nodiscard]] bool isRunning() const noexcept {
+            return m_running;
+        }
+
+        /// <summary>
+        /// start() してからの処理量を取得します。
+        /// </summary>
+        /// <returns>
+        /// 処理量
+        /// </returns>
+        [[nodiscard]] ClientPoolStats getStats() const {
+            ClientPoolStats stats;
+
+            stats.sessions = m_sessionCount;
+
+            stats.workers = m_workers.size();
+
+            stats.ticks = m_ticks;
+
+            stats.services = m_services;
+
+            stats.overruns = m_overruns;
+
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+
+            if (elapsed > 0.0 && stats.workers) {
+                stats.ticksPerSecond = stats.ticks / elapsed;
+
+                stats.servicesPerSecondPerWorker = stats.services / elapsed / stats.workers;
+            }
+
+            return stats;
+        }
+    };
+}  // namespace Utility
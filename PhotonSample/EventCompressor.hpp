@@ -0,0 +1,509 @@
+﻿#pragma once
+#define NO_S3D_USING
+#include <Siv3D.hpp>  // OpenSiv3D v0.4.3
+#include <LoadBalancing-cpp/inc/Client.h>
+#include <bitset>
+#include <chrono>
+
+namespace Utility {
+    namespace detail {
+        /// <summary>
+        /// LZ4 と同じ形式のシーケンスを使う、速さを優先した LZ77 の圧縮
+        /// </summary>
+        /// <remarks>
+        /// 各シーケンスは「トークン(リテラル長4bit, 一致長-4 の4bit) / リテラル / オフセット(2バイト) / 一致長」で、最後のシーケンスはリテラルだけです。
+        /// 辞書は入力の直前にあったデータとして扱い、一致の参照先にできます。
+        /// </remarks>
+        namespace Lz {
+            constexpr size_t MinMatch = 4;
+
+            constexpr size_t MaxOffset = 0xFFFF;
+
+            constexpr s3d::uint32 HashBits = 12;
+
+            [[nodiscard]] inline s3d::uint32 Read32(const s3d::uint8* p) noexcept {
+                s3d::uint32 value;
+                std::memcpy(&value, p, sizeof(value));
+                return value;
+            }
+
+            [[nodiscard]] inline s3d::uint32 Hash(s3d::uint32 value) noexcept {
+                return (value * 2654435761u) >> (32 - HashBits);
+            }
+
+            inline void WriteLength(s3d::Array<s3d::uint8>& out, size_t length) {
+                while (length >= 255) {
+                    out.push_back(255);
+                    length -= 255;
+                }
+
+                out.push_back(static_cast<s3d::uint8>(length));
+            }
+
+            inline void WriteSequence(s3d::Array<s3d::uint8>& out, const s3d::uint8* literals, size_t literalLength, size_t offset, size_t matchLength) {
+                const size_t matchCode = matchLength ? matchLength - MinMatch : 0;
+
+                out.push_back(static_cast<s3d::uint8>((s3d::Min<size_t>(literalLength, 15) << 4) | s3d::Min<size_t>(matchCode, 15)));
+
+                if (literalLength >= 15) {
+                    WriteLength(out, literalLength - 15);
+                }
+
+                out.insert(out.end(), literals, literals + literalLength);
+
+                if (!matchLength) {
+                    return;
+                }
+
+                out.push_back(static_cast<s3d::uint8>(offset & 0xFF));
+                out.push_back(static_cast<s3d::uint8>(offset >> 8));
+
+                if (matchCode >= 15) {
+                    WriteLength(out, matchCode - 15);
+                }
+            }
+
+            /// <summary>
+            /// window の start 以降を圧縮します。start より前は辞書です。
+            /// </summary>
+            inline void Compress(const s3d::Array<s3d::uint8>& window, size_t start, s3d::Array<s3d::uint8>& out) {
+                std::array<s3d::int32, 1u << HashBits> table;
+                table.fill(-1);
+
+                const s3d::uint8* data = window.data();
+                const size_t end = window.size();
+
+                for (size_t i = 0; i + MinMatch <= start; ++i) {
+                    table[Hash(Read32(data + i))] = static_cast<s3d::int32>(i);
+                }
+
+                size_t anchor = start;
+                size_t i = start;
+
+                while (i + MinMatch <= end) {
+                    const s3d::uint32 value = Read32(data + i);
+                    const s3d::uint32 hash = Hash(value);
+                    const s3d::int32 candidate = table[hash];
+
+                    table[hash] = static_cast<s3d::int32>(i);
+
+                    if (candidate < 0 || i - candidate > MaxOffset || Read32(data + candidate) != value) {
+                        ++i;
+                        continue;
+                    }
+
+                    size_t length = MinMatch;
+
+                    while (i + length < end && data[candidate + length] == data[i + length]) {
+                        ++length;
+                    }
+
+                    WriteSequence(out, data + anchor, i - anchor, i - candidate, length);
+
+                    i += length;
+                    anchor = i;
+                }
+
+                WriteSequence(out, data + anchor, end - anchor, 0, 0);
+            }
+
+            [[nodiscard]] inline bool ReadLength(const s3d::uint8*& p, const s3d::uint8* end, size_t& length) {
+                s3d::uint8 byte;
+
+                do {
+                    if (p == end) {
+                        return false;
+                    }
+
+                    byte = *p++;
+                    length += byte;
+                } while (byte == 255);
+
+                return true;
+            }
+
+            /// <summary>
+            /// 圧縮されたデータを window の後ろに展開します。window には辞書を入れておきます。
+            /// </summary>
+            /// <returns>
+            /// 展開後の大きさが rawSize になった場合 true, 壊れたデータの場合は false
+            /// </returns>
+            [[nodiscard]] inline bool Decompress(const s3d::uint8* p, size_t size, size_t rawSize, s3d::Array<s3d::uint8>& window) {
+                const s3d::uint8* const end = p + size;
+                const size_t finalSize = window.size() + rawSize;
+
+                window.reserve(finalSize);
+
+                while (p != end) {
+                    const s3d::uint8 token = *p++;
+
+                    size_t literalLength = token >> 4;
+
+                    if (literalLength == 15 && !ReadLength(p, end, literalLength)) {
+                        return false;
+                    }
+
+                    if (static_cast<size_t>(end - p) < literalLength || window.size() + literalLength > finalSize) {
+                        return false;
+                    }
+
+                    window.insert(window.end(), p, p + literalLength);
+                    p += literalLength;
+
+                    // 最後のシーケンス
+                    if (p == end) {
+                        break;
+                    }
+
+                    if (end - p < 2) {
+                        return false;
+                    }
+
+                    const size_t offset = p[0] | (p[1] << 8);
+                    p += 2;
+
+                    size_t matchLength = token & 0x0F;
+
+                    if (matchLength == 15 && !ReadLength(p, end, matchLength)) {
+                        return false;
+                    }
+
+                    matchLength += MinMatch;
+
+                    if (offset == 0 || offset > window.size() || window.size() + matchLength > finalSize) {
+                        return false;
+                    }
+
+                    // 重なっている場合があるので1バイトずつ写す
+                    size_t from = window.size() - offset;
+
+                    for (size_t k = 0; k < matchLength; ++k) {
+                        window.push_back(window[from++]);
+                    }
+                }
+
+                return window.size() == finalSize;
+            }
+        }  // namespace Lz
+    }  // namespace detail
+
+    /// <summary>
+    /// カスタムイベントの内容の圧縮
+    /// </summary>
+    /// <remarks>
+    /// シリアライズした大きさが閾値以上の内容を圧縮し、予約したイベントコードで [元のイベントコード, フラグ, 元の大きさ, 辞書のID, 圧縮したデータ] として送ります。
+    /// 受け取った側で展開し、元のイベントコードのイベントとしてシーンに届けます。
+    /// </remarks>
+    class EventCompressor : s3d::Uncopyable {
+    public:
+        // 圧縮した内容を送るイベントコード。圧縮を使う間だけ予約される（200 以上は Photon、198 はロックステップの既定値）
+        static constexpr nByte EventCode = 199;
+
+        struct Stats {
+            s3d::uint64 compressedEvents = 0;
+
+            // 閾値未満、または圧縮しても小さくならなかったイベント
+            s3d::uint64 skippedEvents = 0;
+
+            s3d::uint64 rawBytes = 0;
+
+            s3d::uint64 compressedBytes = 0;
+
+            s3d::uint64 decompressedEvents = 0;
+
+            s3d::uint64 failedEvents = 0;
+
+            // 圧縮・展開にかかった時間（シリアライズを含む）
+            double compressMicrosec = 0.0;
+
+            double decompressMicrosec = 0.0;
+
+            /// <summary>
+            /// 圧縮したイベントの、圧縮後の大きさ / 元の大きさ
+            /// </summary>
+            [[nodiscard]] double ratio() const noexcept {
+                return rawBytes ? static_cast<double>(compressedBytes) / rawBytes : 1.0;
+            }
+        };
+
+    private:
+        static constexpr size_t HeaderSize = 10;
+
+        // シリアライズした時に値の前に付く型や長さの大きさの上限
+        static constexpr size_t MaxValueOverhead = 16;
+
+        enum Flags : s3d::uint8 {
+            UsesDictionary = 1,
+        };
+
+        using Clock = std::chrono::steady_clock;
+
+        size_t m_threshold = 0;
+
+        s3d::Array<s3d::uint8> m_dictionary;
+
+        s3d::uint32 m_dictionaryID = 0;
+
+        // 圧縮しないイベントコード
+        std::bitset<256> m_excludedEventCodes;
+
+        Stats m_stats;
+
+        // 確保を減らすため使い回す
+        s3d::Array<s3d::uint8> m_window;
+
+        s3d::Array<s3d::uint8> m_packet;
+
+        [[nodiscard]] static s3d::uint32 Fnv1a(const s3d::Array<s3d::uint8>& data) noexcept {
+            s3d::uint32 hash = 2166136261u;
+
+            for (const s3d::uint8 byte : data) {
+                hash = (hash ^ byte) * 16777619u;
+            }
+
+            return hash;
+        }
+
+        [[nodiscard]] static double ElapsedMicrosec(const Clock::time_point& start) {
+            return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+        }
+
+        /// <summary>
+        /// 固定長の型の1要素の大きさ。可変長の型の場合は 0
+        /// </summary>
+        [[nodiscard]] static size_t ElementSize(nByte type) noexcept {
+            switch (type) {
+            case ExitGames::Common::TypeCode::BYTE:
+            case ExitGames::Common::TypeCode::BOOLEAN:
+                return 1;
+            case ExitGames::Common::TypeCode::SHORT:
+                return 2;
+            case ExitGames::Common::TypeCode::INTEGER:
+            case ExitGames::Common::TypeCode::FLOAT:
+                return 4;
+            case ExitGames::Common::TypeCode::LONG:
+            case ExitGames::Common::TypeCode::DOUBLE:
+                return 8;
+            default:
+                return 0;
+            }
+        }
+
+        /// <summary>
+        /// シリアライズした大きさの上限を、シリアライズせずに求める。スカラーと固定長の型の1次元配列だけ求められる
+        /// </summary>
+        /// <returns>
+        /// 求められない場合は none
+        /// </returns>
+        template<class Ftype>
+        [[nodiscard]] static s3d::Optional<size_t> SizeUpperBound([[maybe_unused]] const Ftype& parameters) {
+            if constexpr (std::is_arithmetic_v<Ftype>) {
+                return MaxValueOverhead + sizeof(Ftype);
+            }
+            else if constexpr (std::is_base_of_v<ExitGames::Common::Object, Ftype>) {
+                const size_t elementSize = ElementSize(parameters.getType());
+
+                if (elementSize == 0) {
+                    return s3d::none;
+                }
+
+                switch (parameters.getDimensions()) {
+                case 0:
+                    return MaxValueOverhead + elementSize;
+                case 1:
+                    return MaxValueOverhead + elementSize * static_cast<size_t>(*parameters.getSizes());
+                default:
+                    return s3d::none;
+                }
+            }
+            else {
+                return s3d::none;
+            }
+        }
+
+    public:
+        /// <summary>
+        /// 圧縮する大きさの閾値を設定します。0 の場合は圧縮しません。
+        /// </summary>
+        void setThreshold(size_t bytes) noexcept {
+            m_threshold = bytes;
+        }
+
+        [[nodiscard]] size_t getThreshold() const noexcept {
+            return m_threshold;
+        }
+
+        [[nodiscard]] bool isEnabled() const noexcept {
+            return m_threshold > 0;
+        }
+
+        /// <summary>
+        /// イベントコードごとに、圧縮するかを設定します。既定では全てのイベントコードを圧縮します。
+        /// </summary>
+        void setEventCompressible(nByte eventCode, bool compressible) {
+            m_excludedEventCodes[eventCode] = !compressible;
+        }
+
+        [[nodiscard]] bool isEventCompressible(nByte eventCode) const {
+            return !m_excludedEventCodes[eventCode];
+        }
+
+        /// <summary>
+        /// 圧縮に使う辞書を設定します。送る側と受け取る側で同じ辞書を設定してください。
+        /// </summary>
+        /// <remarks>
+        /// よく送る内容をシリアライズしたものを並べておくと、小さいイベントも縮むようになります。参照できるのは末尾の 64KB までです。
+        /// </remarks>
+        void setDictionary(s3d::Array<s3d::uint8> dictionary) {
+            if (dictionary.size() > detail::Lz::MaxOffset) {
+                dictionary.erase(dictionary.begin(), dictionary.end() - detail::Lz::MaxOffset);
+            }
+
+            m_dictionary = std::move(dictionary);
+
+            m_dictionaryID = Fnv1a(m_dictionary);
+        }
+
+        [[nodiscard]] const Stats& getStats() const noexcept {
+            return m_stats;
+        }
+
+        void resetStats() noexcept {
+            m_stats = Stats();
+        }
+
+        /// <summary>
+        /// イベントの内容を圧縮します。
+        /// </summary>
+        /// <param name="eventCode">
+        /// 元のイベントコード
+        /// </param>
+        /// <param name="parameters">
+        /// 送る内容
+        /// </param>
+        /// <returns>
+        /// EventCode で送る内容。圧縮しなかった場合は none
+        /// </returns>
+        template<class Ftype>
+        [[nodiscard]] s3d::Optional<ExitGames::Common::Object> compress(nByte eventCode, const Ftype& parameters) {
+            if (!isEventCompressible(eventCode)) {
+                return s3d::none;
+            }
+
+            // 閾値に届かないことが分かる内容は、シリアライズせずに送る
+            if (const auto bound = SizeUpperBound(parameters); bound && *bound < m_threshold) {
+                ++m_stats.skippedEvents;
+                return s3d::none;
+            }
+
+            const auto start = Clock::now();
+
+            ExitGames::Common::Serializer serializer;
+
+            serializer.push(parameters);
+
+            const size_t rawSize = static_cast<size_t>(serializer.getSize());
+
+            if (rawSize < m_threshold) {
+                ++m_stats.skippedEvents;
+                return s3d::none;
+            }
+
+            m_window.assign(m_dictionary.begin(), m_dictionary.end());
+            m_window.insert(m_window.end(), serializer.getData(), serializer.getData() + rawSize);
+
+            m_packet.resize(HeaderSize);
+            m_packet[0] = eventCode;
+            m_packet[1] = m_dictionary.isEmpty() ? 0 : UsesDictionary;
+
+            const s3d::uint32 rawSize32 = static_cast<s3d::uint32>(rawSize);
+            std::memcpy(&m_packet[2], &rawSize32, 4);
+            std::memcpy(&m_packet[6], &m_dictionaryID, 4);
+
+            detail::Lz::Compress(m_window, m_dictionary.size(), m_packet);
+
+            m_stats.compressMicrosec += ElapsedMicrosec(start);
+
+            // 縮まなかった場合はそのまま送る
+            if (m_packet.size() >= rawSize) {
+                ++m_stats.skippedEvents;
+                return s3d::none;
+            }
+
+            ++m_stats.compressedEvents;
+            m_stats.rawBytes += rawSize;
+            m_stats.compressedBytes += m_packet.size();
+
+            return ExitGames::Common::Object(ExitGames::Common::ValueObject<nByte*>(m_packet.data(), static_cast<int>(m_packet.size())));
+        }
+
+        /// <summary>
+        /// EventCode で届いた内容を展開します。
+        /// </summary>
+        /// <param name="content">
+        /// 届いた内容
+        /// </param>
+        /// <param name="eventCode">
+        /// 元のイベントコード
+        /// </param>
+        /// <param name="parameters">
+        /// 元の内容
+        /// </param>
+        /// <returns>
+        /// 展開できた場合 true, 壊れていたり辞書が違ったりした場合は false
+        /// </returns>
+        bool decompress(const ExitGames::Common::Object& content, nByte& eventCode, ExitGames::Common::Object& parameters) {
+            const auto start = Clock::now();
+
+            const ExitGames::Common::ValueObject<nByte*> valueObject(content);
+
+            const nByte* packet = *valueObject.getDataAddress();
+
+            const auto* sizes = valueObject.getSizes();
+
+            if (!packet || !sizes || static_cast<size_t>(*sizes) < HeaderSize) {
+                ++m_stats.failedEvents;
+                return false;
+            }
+
+            s3d::uint32 rawSize;
+            s3d::uint32 dictionaryID;
+            std::memcpy(&rawSize, packet + 2, 4);
+            std::memcpy(&dictionaryID, packet + 6, 4);
+
+            const bool usesDictionary = packet[1] & UsesDictionary;
+
+            if (usesDictionary && dictionaryID != m_dictionaryID) {
+                ++m_stats.failedEvents;
+                return false;
+            }
+
+            m_window.clear();
+
+            if (usesDictionary) {
+                m_window.assign(m_dictionary.begin(), m_dictionary.end());
+            }
+
+            const size_t dictionarySize = m_window.size();
+
+            if (!detail::Lz::Decompress(packet + HeaderSize, *sizes - HeaderSize, rawSize, m_window)) {
+                ++m_stats.failedEvents;
+                return false;
+            }
+
+            ExitGames::Common::DeSerializer deserializer(m_window.data() + dictionarySize, static_cast<int>(rawSize));
+
+            if (!deserializer.pop(parameters)) {
+                ++m_stats.failedEvents;
+                return false;
+            }
+
+            eventCode = packet[0];
+
+            ++m_stats.decompressedEvents;
+            m_stats.decompressMicrosec += ElapsedMicrosec(start);
+
+            return true;
+        }
+    };
+}  // namespace Utility
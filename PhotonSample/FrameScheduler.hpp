@@ -0,0 +1,219 @@
+﻿#pragma once
+#define NO_S3D_USING
+#include <Siv3D.hpp>  // OpenSiv3D v0.4.3
+#include "Logger.hpp"
+
+namespace Utility {
+    struct FrameRateSettings {
+        // シーンの update() を呼ぶ頻度（0 の場合は毎フレーム）
+        double updateHz = 0.0;
+
+        // Client::service() を呼ぶ頻度（0 の場合は毎フレーム）
+        double networkHz = 0.0;
+
+        // ウィンドウにフォーカスが無い時や最小化している時のフレームレート（0 の場合は下げない）
+        // networkHz が 0 の場合も、通信が FrameScheduler::BackgroundNetworkHz を下回るほどは下げない
+        double backgroundHz = 0.0;
+
+        // 最小化している時に描画をやめるか
+        bool suspendDrawWhenMinimized = true;
+    };
+
+    /// <summary>
+    /// 1秒あたりの回数
+    /// </summary>
+    struct FrameRateStats {
+        double frames = 0.0;
+
+        double updates = 0.0;
+
+        double draws = 0.0;
+
+        double services = 0.0;
+
+        // 1秒のうち、beginFrame() から endFrame() までにかかった時間の割合（CPU の使用量の目安）
+        double busy = 0.0;
+    };
+
+    /// <summary>
+    /// 描画・シーンの更新・通信をそれぞれの頻度で行うための管理
+    /// </summary>
+    /// <remarks>
+    /// 更新と通信は経過時間を貯めて、間隔に達したフレームでだけ行います。
+    /// ウィンドウが裏にある間はフレームレート自体を下げますが、通信の頻度を下回らないようにします。
+    /// </remarks>
+    class FrameScheduler {
+    public:
+        // networkHz が 0（毎フレーム）の時に、裏にある間も保つ通信の頻度
+        static constexpr double BackgroundNetworkHz = 30.0;
+
+    private:
+        FrameRateSettings m_settings;
+
+        double m_updateAccumulator = 0.0;
+
+        double m_networkAccumulator = 0.0;
+
+        bool m_updateDue = true;
+
+        bool m_networkDue = true;
+
+        bool m_drawDue = true;
+
+        // 設定したフレームレート（none の場合は垂直同期）
+        s3d::Optional<double> m_targetFrameRate;
+
+        FrameRateStats m_counts;
+
+        FrameRateStats m_stats;
+
+        s3d::Stopwatch m_statsStopwatch{ true };
+
+        s3d::Stopwatch m_frameStopwatch;
+
+        /// <summary>
+        /// 経過時間を貯め、間隔に達していれば1回分を消費します。
+        /// </summary>
+        [[nodiscard]] static bool Consume(double& accumulator, double hz, double deltaTime) {
+            if (hz <= 0.0) {
+                return true;
+            }
+
+            const double interval = 1.0 / hz;
+
+            accumulator += deltaTime;
+
+            if (accumulator < interval) {
+                return false;
+            }
+
+            // フレームが遅れても、まとめて何回も行わない
+            accumulator = s3d::Min(accumulator - interval, interval);
+
+            return true;
+        }
+
+        void applyTargetFrameRate(const s3d::Optional<double>& target) {
+            if (target == m_targetFrameRate) {
+                return;
+            }
+
+            m_targetFrameRate = target;
+
+            s3d::Graphics::SetTargetFrameRateHz(target);
+        }
+
+    public:
+        void setSettings(const FrameRateSettings& settings) {
+            m_settings = settings;
+
+            m_updateAccumulator = 0.0;
+
+            m_networkAccumulator = 0.0;
+        }
+
+        [[nodiscard]] const FrameRateSettings& getSettings() const noexcept {
+            return m_settings;
+        }
+
+        /// <summary>
+        /// フレームの始めに、このフレームで行うことを決めます。
+        /// </summary>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void beginFrame() {
+            m_frameStopwatch.restart();
+
+            const double deltaTime = s3d::Scene::DeltaTime();
+
+            const s3d::WindowState& window = s3d::Window::GetState();
+
+            m_updateDue = Consume(m_updateAccumulator, m_settings.updateHz, deltaTime);
+
+            m_networkDue = Consume(m_networkAccumulator, m_settings.networkHz, deltaTime);
+
+            m_drawDue = !(window.minimized && m_settings.suspendDrawWhenMinimized);
+
+            const bool background = window.minimized || !window.focused;
+
+            if (m_settings.backgroundHz > 0.0 && background) {
+                // 毎フレーム通信する設定でも、通信の頻度が落ちすぎないようにする
+                const double networkHz = (m_settings.networkHz > 0.0) ? m_settings.networkHz : BackgroundNetworkHz;
+
+                applyTargetFrameRate(std::max({ m_settings.backgroundHz, networkHz, m_settings.updateHz }));
+            }
+            else {
+                applyTargetFrameRate(s3d::none);
+            }
+
+            ++m_counts.frames;
+
+            if (m_updateDue) {
+                ++m_counts.updates;
+            }
+
+            if (m_drawDue) {
+                ++m_counts.draws;
+            }
+
+            const double elapsed = m_statsStopwatch.sF();
+
+            if (elapsed >= 1.0) {
+                m_stats.frames = m_counts.frames / elapsed;
+                m_stats.updates = m_counts.updates / elapsed;
+                m_stats.draws = m_counts.draws / elapsed;
+                m_stats.services = m_counts.services / elapsed;
+                m_stats.busy = m_counts.busy / elapsed;
+
+                PHOTONSAMPLE_LOG(LogLevel::Debug, U"frame rates", LogField(U"fps", m_stats.frames), LogField(U"services", m_stats.services), LogField(U"busy", m_stats.busy), LogField(U"background", background));
+
+                m_counts = FrameRateStats();
+
+                m_statsStopwatch.restart();
+            }
+        }
+
+        /// <summary>
+        /// フレームの処理が終わったことを記録します。
+        /// </summary>
+        void endFrame() {
+            m_counts.busy += m_frameStopwatch.sF();
+        }
+
+        /// <summary>
+        /// このフレームでシーンを更新するかを返します。
+        /// </summary>
+        [[nodiscard]] bool isUpdateDue() const noexcept {
+            return m_updateDue;
+        }
+
+        /// <summary>
+        /// このフレームで通信を行うかを返します。
+        /// </summary>
+        [[nodiscard]] bool isNetworkDue() const noexcept {
+            return m_networkDue;
+        }
+
+        /// <summary>
+        /// このフレームで描画するかを返します。
+        /// </summary>
+        [[nodiscard]] bool isDrawDue() const noexcept {
+            return m_drawDue;
+        }
+
+        /// <summary>
+        /// 通信を行ったことを記録します。
+        /// </summary>
+        void countService() noexcept {
+            ++m_counts.services;
+        }
+
+        /// <summary>
+        /// 直近1秒間の回数を取得します。
+        /// </summary>
+        [[nodiscard]] const FrameRateStats& getStats() const noexcept {
+            return m_stats;
+        }
+    };
+}  // namespace Utility
@@ -0,0 +1,381 @@
+﻿#pragma once
+#define NO_S3D_USING
+#include <Siv3D.hpp>  // OpenSiv3D v0.4.3
+#include <LoadBalancing-cpp/inc/Client.h>
+
+namespace Utility {
+    /// <summary>
+    /// 1ティック分の入力（押されているボタンのビットなど）
+    /// </summary>
+    using LockstepInput = s3d::uint32;
+
+    struct LockstepSettings {
+        // 入力を送るイベントコード（200 以上は Photon の予約、199 は EventCompressor::EventCode なので、それ以外を指定する）
+        nByte eventCode = 198;
+
+        // 1ティックの長さ（入力遅延の計算に使う）
+        s3d::int32 tickMillisec = 33;
+
+        // 入力遅延（ティック数）の範囲
+        s3d::int32 minInputDelay = 2;
+
+        s3d::int32 maxInputDelay = 15;
+
+        // 何ティック分の入力が溜まったら送るか
+        s3d::int32 ticksPerPacket = 2;
+
+        // 1つのパケットに入れる入力の最大数。相手が受け取っていない最も古い入力から順に入れ、相手が受け取ったと分かるまで同じ入力を送り続ける。
+        s3d::int32 maxInputsPerPacket = 32;
+
+        // 新しい入力が無くても、相手が受け取っていない入力を送り直す間隔
+        s3d::int32 resendIntervalMillisec = 50;
+
+        // 何ティックごとに状態のチェックサムを比べるか
+        s3d::int32 checksumInterval = 10;
+    };
+
+    /// <summary>
+    /// 2人用のロックステップ
+    /// </summary>
+    /// <remarks>
+    /// 各ティックの入力だけを送り合い、両方の入力が揃ったティックだけシミュレーションを進めます。
+    /// 送る量は状態の大きさに関係なく、1パケットあたり最大 maxInputsPerPacket 個の入力です。
+    /// 入力遅延は相手との往復時間に合わせて変わります。
+    /// </remarks>
+    class LockstepEngine : s3d::Uncopyable {
+    private:
+        static constexpr s3d::int32 BufferSize = 512;
+
+        // パケットの先頭に置く値の数
+        static constexpr s3d::int32 HeaderSize = 8;
+
+        LockstepSettings m_settings;
+
+        int m_localPlayerNr;
+
+        int m_remotePlayerNr;
+
+        // 入力はティックを BufferSize で割った余りの位置に置く
+        std::array<LockstepInput, BufferSize> m_localInputs{};
+
+        std::array<LockstepInput, BufferSize> m_remoteInputs{};
+
+        // 次に進めるティック
+        s3d::int32 m_currentTick = 0;
+
+        // 入力が揃っている最後のティック
+        s3d::int32 m_localLast = -1;
+
+        s3d::int32 m_remoteLast = -1;
+
+        // 相手が受け取った自分の入力の最後のティック
+        s3d::int32 m_remoteAck = -1;
+
+        s3d::int32 m_inputDelay;
+
+        s3d::int32 m_unsentInputs = 0;
+
+        double m_lastSendTime = -1e9;
+
+        // 往復時間の推定
+        double m_roundTripTime = 0.0;
+
+        bool m_hasRoundTripTime = false;
+
+        // 相手から届いた最新の送信時刻と、それを受け取った時刻
+        s3d::int32 m_peerTimestamp = -1;
+
+        double m_peerTimestampReceivedAt = 0.0;
+
+        struct Checksum {
+            // 記録していない場合は -1
+            s3d::int32 tick = -1;
+
+            s3d::uint32 sum = 0;
+        };
+
+        // チェックサム（checksumInterval ごとのティックの分だけ）。古いティックの値が残っていても比べないように、ティックも一緒に持つ
+        std::array<Checksum, BufferSize> m_localChecksums;
+
+        std::array<Checksum, BufferSize> m_remoteChecksums;
+
+        s3d::int32 m_lastChecksumTick = -1;
+
+        s3d::Optional<s3d::int32> m_desyncTick;
+
+        [[nodiscard]] static size_t Index(const s3d::int32 tick) noexcept {
+            return static_cast<size_t>(tick) % BufferSize;
+        }
+
+        void compareChecksum(const s3d::int32 tick) {
+            const size_t index = Index(tick / m_settings.checksumInterval);
+
+            const Checksum& local = m_localChecksums[index];
+            const Checksum& remote = m_remoteChecksums[index];
+
+            if (local.tick != tick || remote.tick != tick) {
+                return;
+            }
+
+            if (!m_desyncTick && local.sum != remote.sum) {
+                m_desyncTick = tick;
+            }
+        }
+
+        void updateInputDelay() {
+            // 入力が相手に届くまでの片道の時間に、1ティックの余裕を足す
+            const double oneWay = m_roundTripTime / 2.0;
+
+            const s3d::int32 delay = static_cast<s3d::int32>(std::ceil(oneWay / m_settings.tickMillisec)) + 1;
+
+            m_inputDelay = s3d::Clamp(delay, m_settings.minInputDelay, m_settings.maxInputDelay);
+        }
+
+    public:
+        /// <param name="settings">
+        /// 設定
+        /// </param>
+        /// <param name="localPlayerNr">
+        /// 自分のプレイヤー番号
+        /// </param>
+        /// <param name="remotePlayerNr">
+        /// 相手のプレイヤー番号
+        /// </param>
+        LockstepEngine(const LockstepSettings& settings, int localPlayerNr, int remotePlayerNr)
+            : m_settings(settings), m_localPlayerNr(localPlayerNr), m_remotePlayerNr(remotePlayerNr), m_inputDelay(settings.minInputDelay) {}
+
+        [[nodiscard]] const LockstepSettings& getSettings() const noexcept {
+            return m_settings;
+        }
+
+        [[nodiscard]] int getRemotePlayerNr() const noexcept {
+            return m_remotePlayerNr;
+        }
+
+        /// <summary>
+        /// このティックの自分の入力を追加します。1ティックに1回呼んでください。
+        /// </summary>
+        /// <remarks>
+        /// 入力は現在のティックから入力遅延の分だけ後のティックに使われます。
+        /// 入力遅延が増えた場合は直前の入力で間を埋め、減った場合は遅延が追いつくまで入力を捨てます。
+        /// </remarks>
+        /// <param name="input">
+        /// 入力
+        /// </param>
+        /// <returns>
+        /// 入力を受け付けた場合 true, 相手を待っていて受け付けられない場合は false
+        /// </returns>
+        bool addLocalInput(LockstepInput input) {
+            const s3d::int32 target = m_currentTick + m_inputDelay;
+
+            if (target <= m_localLast) {
+                return false;
+            }
+
+            // 相手が受け取っていない入力でバッファが埋まっている
+            if (target - m_remoteAck >= BufferSize || target - m_currentTick >= BufferSize) {
+                return false;
+            }
+
+            const LockstepInput previous = (m_localLast >= 0) ? m_localInputs[Index(m_localLast)] : input;
+
+            while (m_localLast + 1 < target) {
+                m_localInputs[Index(++m_localLast)] = previous;
+
+                ++m_unsentInputs;
+            }
+
+            m_localInputs[Index(++m_localLast)] = input;
+
+            ++m_unsentInputs;
+
+            return true;
+        }
+
+        /// <summary>
+        /// 次のティックの入力が両方揃っているかを返します。
+        /// </summary>
+        [[nodiscard]] bool canAdvance() const noexcept {
+            return m_currentTick <= m_localLast && m_currentTick <= m_remoteLast;
+        }
+
+        /// <summary>
+        /// 次のティックに進みます。canAdvance() が true の時だけ呼んでください。
+        /// </summary>
+        /// <returns>
+        /// このティックの入力（プレイヤー番号の小さい順）
+        /// </returns>
+        std::array<LockstepInput, 2> advance() {
+            assert(canAdvance());
+
+            const LockstepInput local = m_localInputs[Index(m_currentTick)];
+            const LockstepInput remote = m_remoteInputs[Index(m_currentTick)];
+
+            ++m_currentTick;
+
+            if (m_localPlayerNr < m_remotePlayerNr) {
+                return { local, remote };
+            }
+
+            return { remote, local };
+        }
+
+        /// <summary>
+        /// 次に進めるティックを取得します。
+        /// </summary>
+        [[nodiscard]] s3d::int32 getCurrentTick() const noexcept {
+            return m_currentTick;
+        }
+
+        [[nodiscard]] s3d::int32 getInputDelay() const noexcept {
+            return m_inputDelay;
+        }
+
+        [[nodiscard]] double getRoundTripTime() const noexcept {
+            return m_roundTripTime;
+        }
+
+        /// <summary>
+        /// ティックを進めた後の状態のチェックサムを記録します。checksumInterval の倍数のティックだけ記録されます。
+        /// </summary>
+        /// <param name="tick">
+        /// 進めたティック
+        /// </param>
+        /// <param name="checksum">
+        /// 状態のチェックサム
+        /// </param>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void setChecksum(s3d::int32 tick, s3d::uint32 checksum) {
+            if (tick % m_settings.checksumInterval) {
+                return;
+            }
+
+            m_localChecksums[Index(tick / m_settings.checksumInterval)] = { tick, checksum };
+
+            m_lastChecksumTick = tick;
+
+            compareChecksum(tick);
+        }
+
+        /// <summary>
+        /// 状態のずれを検出したティックを取得します。
+        /// </summary>
+        /// <returns>
+        /// ずれていない場合は none
+        /// </returns>
+        [[nodiscard]] const s3d::Optional<s3d::int32>& getDesyncTick() const noexcept {
+            return m_desyncTick;
+        }
+
+        /// <summary>
+        /// 送るべき入力があればパケットを作ります。
+        /// </summary>
+        /// <param name="now">
+        /// 現在の時刻（ミリ秒）
+        /// </param>
+        /// <returns>
+        /// 送るパケット。送る必要が無い場合は none
+        /// </returns>
+        [[nodiscard]] s3d::Optional<ExitGames::Common::Object> makePacket(const double now) {
+            const bool hasUnacked = m_localLast > m_remoteAck;
+
+            if (m_unsentInputs < m_settings.ticksPerPacket && !(hasUnacked && now - m_lastSendTime >= m_settings.resendIntervalMillisec)) {
+                return s3d::none;
+            }
+
+            // 相手は続きの入力しか取り込まないので、必ず受け取っていない最も古い入力から送り、入りきらない新しい入力は次に回す
+            const s3d::int32 first = m_remoteAck + 1;
+
+            const s3d::int32 count = s3d::Clamp(m_localLast - first + 1, 0, m_settings.maxInputsPerPacket);
+
+            std::array<int, HeaderSize + BufferSize> packet;
+
+            packet[0] = first;
+            packet[1] = count;
+            packet[2] = m_remoteLast;
+            packet[3] = m_lastChecksumTick;
+            packet[4] = (m_lastChecksumTick >= 0) ? static_cast<int>(m_localChecksums[Index(m_lastChecksumTick / m_settings.checksumInterval)].sum) : 0;
+            packet[5] = static_cast<int>(now);
+            packet[6] = m_peerTimestamp;
+            packet[7] = (m_peerTimestamp >= 0) ? static_cast<int>(now - m_peerTimestampReceivedAt) : 0;
+
+            for (s3d::int32 i = 0; i < count; ++i) {
+                packet[HeaderSize + i] = static_cast<int>(m_localInputs[Index(first + i)]);
+            }
+
+            // 入りきらなかった入力は、まだ送っていない入力として残す
+            m_unsentInputs = m_localLast - (first + count - 1);
+
+            m_lastSendTime = now;
+
+            return ExitGames::Common::Object(ExitGames::Common::ValueObject<int*>(packet.data(), static_cast<short>(HeaderSize + count)));
+        }
+
+        /// <summary>
+        /// 相手から届いたパケットを取り込みます。
+        /// </summary>
+        /// <param name="content">
+        /// 受信したイベントの内容
+        /// </param>
+        /// <param name="now">
+        /// 現在の時刻（ミリ秒）
+        /// </param>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void receivePacket(const ExitGames::Common::Object& content, const double now) {
+            const ExitGames::Common::ValueObject<int*> valueObject(content);
+
+            const int* packet = *valueObject.getDataAddress();
+
+            const short* sizes = valueObject.getSizes();
+
+            if (!packet || !sizes || *sizes < HeaderSize) {
+                return;
+            }
+
+            const s3d::int32 first = packet[0];
+            const s3d::int32 count = s3d::Min<s3d::int32>(packet[1], *sizes - HeaderSize);
+
+            // 順序が入れ替わったり重複したりしても、続きの入力だけを取り込む
+            for (s3d::int32 i = 0; i < count; ++i) {
+                const s3d::int32 tick = first + i;
+
+                if (tick == m_remoteLast + 1 && tick - m_currentTick < BufferSize) {
+                    m_remoteInputs[Index(tick)] = static_cast<LockstepInput>(packet[HeaderSize + i]);
+
+                    m_remoteLast = tick;
+                }
+            }
+
+            m_remoteAck = s3d::Max(m_remoteAck, packet[2]);
+
+            const s3d::int32 checksumTick = packet[3];
+
+            if (checksumTick >= 0 && checksumTick % m_settings.checksumInterval == 0) {
+                m_remoteChecksums[Index(checksumTick / m_settings.checksumInterval)] = { checksumTick, static_cast<s3d::uint32>(packet[4]) };
+
+                compareChecksum(checksumTick);
+            }
+
+            if (packet[5] > m_peerTimestamp) {
+                m_peerTimestamp = packet[5];
+
+                m_peerTimestampReceivedAt = now;
+            }
+
+            // 相手が自分の送信時刻を返してきたら、相手が持っていた時間を除いて往復時間とする
+            if (packet[6] >= 0) {
+                const double sample = s3d::Max(0.0, now - packet[6] - packet[7]);
+
+                m_roundTripTime = m_hasRoundTripTime ? (m_roundTripTime * 0.875 + sample * 0.125) : sample;
+
+                m_hasRoundTripTime = true;
+
+                updateInputDelay();
+            }
+        }
+    };
+}  // namespace Utility
@@ -0,0 +1,457 @@
+﻿#pragma once
+#define NO_S3D_USING
+#include <Siv3D.hpp>  // OpenSiv3D v0.4.3
+#include <LoadBalancing-cpp/inc/Client.h>
+#include <atomic>
+#include <thread>
+
+// この値より低いレベルのログはコンパイル時に取り除かれる（0: Trace ～ 4: Error, 5: 全て取り除く）
+#ifndef PHOTONSAMPLE_LOG_MIN_LEVEL
+#    ifdef _DEBUG
+#        define PHOTONSAMPLE_LOG_MIN_LEVEL 0
+#    else
+#        define PHOTONSAMPLE_LOG_MIN_LEVEL 1
+#    endif
+#endif
+
+/// <summary>
+/// ログを書きます。level が PHOTONSAMPLE_LOG_MIN_LEVEL より低い場合は何もしないコードになります。
+/// </summary>
+/// <example>
+/// PHOTONSAMPLE_LOG(Utility::LogLevel::Info, U"connected", Utility::LogField(U"errorCode", errorCode));
+/// </example>
+#define PHOTONSAMPLE_LOG(level, ...)                                               \
+    do {                                                                           \
+        if constexpr (static_cast<int>(level) >= PHOTONSAMPLE_LOG_MIN_LEVEL) {     \
+            ::Utility::Logger::Get().write(level, __VA_ARGS__);                    \
+        }                                                                          \
+    } while (false)
+
+namespace Utility {
+    enum class LogLevel : s3d::uint8 {
+        Trace,
+
+        Debug,
+
+        Info,
+
+        Warning,
+
+        Error,
+
+        Off,
+    };
+
+    /// <summary>
+    /// Photon の debugLevel をログのレベルに変換します。
+    /// </summary>
+    [[nodiscard]] inline LogLevel ToLogLevel(int debugLevel) noexcept {
+        switch (debugLevel) {
+        case ExitGames::Common::DebugLevel::ERRORS:
+            return LogLevel::Error;
+        case ExitGames::Common::DebugLevel::WARNINGS:
+            return LogLevel::Warning;
+        case ExitGames::Common::DebugLevel::INFO:
+            return LogLevel::Info;
+        default:
+            return LogLevel::Trace;
+        }
+    }
+
+    /// <summary>
+    /// ログに付ける名前付きの値
+    /// </summary>
+    /// <remarks>
+    /// 名前は文字列リテラルなど、ログが書き出されるまで残るものを指定してください。
+    /// </remarks>
+    struct LogField {
+        enum class Type : s3d::uint8 {
+            Int,
+
+            Double,
+
+            Bool,
+        };
+
+        const char32_t* name = nullptr;
+
+        Type type = Type::Int;
+
+        union {
+            s3d::int64 i;
+
+            double d;
+        };
+
+        LogField() : i(0) {}
+
+        template<class Type_, std::enable_if_t<std::is_arithmetic_v<Type_>>* = nullptr>
+        LogField(const char32_t* name_, Type_ value) : name(name_) {
+            if constexpr (std::is_same_v<Type_, bool>) {
+                type = Type::Bool;
+                i = value;
+            }
+            else if constexpr (std::is_floating_point_v<Type_>) {
+                type = Type::Double;
+                d = value;
+            }
+            else {
+                type = Type::Int;
+                i = static_cast<s3d::int64>(value);
+            }
+        }
+    };
+
+    /// <summary>
+    /// 書き出し待ちのログ1件。確保を避けるため、大きさは固定です。
+    /// </summary>
+    struct LogRecord {
+        static constexpr size_t MaxMessageLength = 192;
+
+        static constexpr size_t MaxFields = 4;
+
+        double time = 0.0;
+
+        LogLevel level = LogLevel::Info;
+
+        // message が UTF-16 のコード単位で入っているか
+        bool utf16 = false;
+
+        s3d::uint16 messageLength = 0;
+
+        s3d::uint8 fieldCount = 0;
+
+        std::array<char32_t, MaxMessageLength> message;
+
+        std::array<LogField, MaxFields> fields;
+
+        template<class Char>
+        void setMessage(const Char* data, size_t length) {
+            messageLength = static_cast<s3d::uint16>(s3d::Min(length, MaxMessageLength));
+
+            for (size_t i = 0; i < messageLength; ++i) {
+                message[i] = static_cast<char32_t>(data[i]);
+            }
+        }
+    };
+
+    /// <summary>
+    /// フレームを止めないログ
+    /// </summary>
+    /// <remarks>
+    /// 書き込む側はロックを取らずに固定長のリングバッファに積むだけで、整形とファイルへの書き出しは専用のスレッドで行います。
+    /// 複数のスレッドから書き込めます。バッファが一杯の場合、ログは捨てられて getDroppedCount() に数えられます。
+    /// </remarks>
+    class Logger : s3d::Uncopyable {
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+
+            LogRecord record;
+        };
+
+        std::unique_ptr<Cell[]> m_cells;
+
+        size_t m_mask = 0;
+
+        alignas(64) std::atomic<size_t> m_enqueuePosition{ 0 };
+
+        // 読み出すのは書き出し用のスレッドだけ
+        alignas(64) size_t m_dequeuePosition = 0;
+
+        std::atomic<LogLevel> m_level{ LogLevel::Off };
+
+        std::atomic<s3d::uint64> m_dropped{ 0 };
+
+        std::atomic<bool> m_running{ false };
+
+        std::thread m_thread;
+
+        s3d::TextWriter m_writer;
+
+        s3d::Stopwatch m_stopwatch{ true };
+
+        Logger() = default;
+
+        [[nodiscard]] bool tryPop(LogRecord& record) {
+            Cell& cell = m_cells[m_dequeuePosition & m_mask];
+
+            if (cell.sequence.load(std::memory_order_acquire) != m_dequeuePosition + 1) {
+                return false;
+            }
+
+            record = cell.record;
+
+            cell.sequence.store(m_dequeuePosition + m_mask + 1, std::memory_order_release);
+
+            ++m_dequeuePosition;
+
+            return true;
+        }
+
+        [[nodiscard]] static s3d::StringView LevelName(LogLevel level) {
+            switch (level) {
+            case LogLevel::Trace:
+                return U"TRACE";
+            case LogLevel::Debug:
+                return U"DEBUG";
+            case LogLevel::Info:
+                return U"INFO ";
+            case LogLevel::Warning:
+                return U"WARN ";
+            default:
+                return U"ERROR";
+            }
+        }
+
+        void format(const LogRecord& record, s3d::String& line) const {
+            line.clear();
+
+            line += s3d::ToString(record.time, 3);
+            line += U' ';
+            line += LevelName(record.level);
+            line += U' ';
+
+            if (record.utf16) {
+                std::wstring wide(record.messageLength, L'\0');
+
+                for (size_t i = 0; i < record.messageLength; ++i) {
+                    wide[i] = static_cast<wchar_t>(record.message[i]);
+                }
+
+                line += s3d::Unicode::FromWString(wide);
+            }
+            else {
+                line += s3d::StringView(record.message.data(), record.messageLength);
+            }
+
+            for (size_t i = 0; i < record.fieldCount; ++i) {
+                const LogField& field = record.fields[i];
+
+                line += U' ';
+                line += field.name;
+                line += U'=';
+
+                switch (field.type) {
+                case LogField::Type::Double:
+                    line += s3d::ToString(field.d);
+                    break;
+                case LogField::Type::Bool:
+                    line += field.i ? U"true" : U"false";
+                    break;
+                default:
+                    line += s3d::ToString(field.i);
+                    break;
+                }
+            }
+        }
+
+        void run() {
+            LogRecord record;
+
+            s3d::String line;
+
+            while (true) {
+                // 止める前に積まれたログは全て書き出す
+                const bool running = m_running.load(std::memory_order_acquire);
+
+                bool written = false;
+
+                while (tryPop(record)) {
+                    format(record, line);
+
+                    m_writer.writeln(line);
+
+                    written = true;
+                }
+
+                if (!running) {
+                    break;
+                }
+
+                if (written) {
+                    m_writer.flush();
+                }
+                else {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+            }
+
+            if (const s3d::uint64 dropped = m_dropped.load()) {
+                m_writer.writeln(U"dropped=", dropped);
+            }
+
+            m_writer.close();
+        }
+
+    public:
+        ~Logger() {
+            close();
+        }
+
+        /// <summary>
+        /// ログを取得します。
+        /// </summary>
+        [[nodiscard]] static Logger& Get() {
+            static Logger logger;
+            return logger;
+        }
+
+        /// <summary>
+        /// ログの書き出しを始めます。
+        /// </summary>
+        /// <param name="path">
+        /// 書き出すファイル
+        /// </param>
+        /// <param name="level">
+        /// 書き出す最低限のレベル
+        /// </param>
+        /// <param name="capacity">
+        /// 書き出し待ちにできるログの数（2の累乗に切り上げます）
+        /// </param>
+        /// <returns>
+        /// ファイルを開けた場合 true, それ以外の場合は false
+        /// </returns>
+        bool open(const s3d::FilePath& path, LogLevel level = LogLevel::Debug, size_t capacity = 4096) {
+            close();
+
+            if (!m_writer.open(path)) {
+                return false;
+            }
+
+            size_t size = 2;
+
+            while (size < capacity) {
+                size *= 2;
+            }
+
+            m_cells = std::make_unique<Cell[]>(size);
+
+            for (size_t i = 0; i < size; ++i) {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+
+            m_mask = size - 1;
+            m_enqueuePosition.store(0, std::memory_order_relaxed);
+            m_dequeuePosition = 0;
+            m_dropped.store(0, std::memory_order_relaxed);
+
+            m_running.store(true, std::memory_order_release);
+
+            m_thread = std::thread(&Logger::run, this);
+
+            m_level.store(level, std::memory_order_release);
+
+            return true;
+        }
+
+        /// <summary>
+        /// 書き出し待ちのログを全て書き出して、ファイルを閉じます。
+        /// </summary>
+        /// <remarks>
+        /// 他のスレッドが書き込んでいない時に呼んでください。
+        /// </remarks>
+        void close() {
+            m_level.store(LogLevel::Off, std::memory_order_release);
+
+            if (!m_thread.joinable()) {
+                return;
+            }
+
+            m_running.store(false, std::memory_order_release);
+
+            m_thread.join();
+        }
+
+        void setLevel(LogLevel level) noexcept {
+            if (m_thread.joinable()) {
+                m_level.store(level, std::memory_order_release);
+            }
+        }
+
+        [[nodiscard]] bool isEnabled(LogLevel level) const noexcept {
+            return level >= m_level.load(std::memory_order_relaxed);
+        }
+
+        /// <summary>
+        /// バッファが一杯で捨てたログの数を取得します。
+        /// </summary>
+        [[nodiscard]] s3d::uint64 getDroppedCount() const noexcept {
+            return m_dropped.load(std::memory_order_relaxed);
+        }
+
+        /// <summary>
+        /// ログを積みます。待つことはありません。
+        /// </summary>
+        /// <param name="level">
+        /// レベル
+        /// </param>
+        /// <param name="message">
+        /// メッセージ（長いものは切り詰めます）
+        /// </param>
+        /// <param name="fields">
+        /// メッセージに付ける値（最大 LogRecord::MaxFields 個）
+        /// </param>
+        /// <returns>
+        /// 積めた場合 true, それ以外の場合は false
+        /// </returns>
+        template<class Message, class... Fields>
+        bool write(LogLevel level, const Message& message, const Fields&... fields) {
+            static_assert(sizeof...(Fields) <= LogRecord::MaxFields, "Too many log fields");
+
+            if (!isEnabled(level)) {
+                return false;
+            }
+
+            size_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+
+            Cell* cell;
+
+            while (true) {
+                cell = &m_cells[position & m_mask];
+
+                const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(cell->sequence.load(std::memory_order_acquire)) - static_cast<std::ptrdiff_t>(position);
+
+                if (difference == 0) {
+                    if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else if (difference < 0) {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else {
+                    position = m_enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+
+            LogRecord& record = cell->record;
+
+            record.time = m_stopwatch.sF();
+            record.level = level;
+
+            if constexpr (std::is_convertible_v<Message, s3d::StringView>) {
+                const s3d::StringView view(message);
+
+                record.utf16 = false;
+                record.setMessage(view.data(), view.size());
+            }
+            else {
+                // ExitGames::Common::JString
+                record.utf16 = true;
+                record.setMessage(message.cstr(), message.length());
+            }
+
+            record.fieldCount = static_cast<s3d::uint8>(sizeof...(Fields));
+
+            size_t index = 0;
+
+            ((record.fields[index++] = fields), ...);
+
+            cell->sequence.store(position + 1, std::memory_order_release);
+
+            return true;
+        }
+    };
+}  // namespace Utility
@@ -1,4 +1,9 @@
 ﻿#include "SceneMaster.hpp"
+#include "Benchmark.hpp"
+#include "ClientPool.hpp"
+
+// PHOTONSAMPLE_COUNT_ALLOCATIONS を定義した場合は、全ての確保を数える
+PHOTONSAMPLE_DEFINE_ALLOCATION_COUNTER()
 
 /// <summary>
 /// 共通データ
@@ -46,7 +51,9 @@ namespace Sample {
             , m_startButton(s3d::Arg::center(s3d::Scene::Center()), 300, 60)
             , m_exitButton(s3d::Arg::center(s3d::Scene::Center().movedBy(0, 100)), 300, 60)
             , m_startButtonTransition(s3d::SecondsF(0.4), s3d::SecondsF(0.2))
-            , m_exitButtonTransition(s3d::SecondsF(0.4), s3d::SecondsF(0.2)) {}
+            , m_exitButtonTransition(s3d::SecondsF(0.4), s3d::SecondsF(0.2)) {
+            PreConnect();  // 「接続する」が押される前に接続しておく
+        }
 
         void update() override {
             m_startButtonTransition.update(m_startButton.mouseOver());
@@ -94,8 +101,15 @@ namespace Sample {
                 return;
             }
 
-            s3d::Print(U"接続しました");
-            GetClient().opJoinRandomRoom(getData().GetCustomProperties(), 2);   // 第2引数でルームに参加できる人数を設定します。
+            s3d::Print(U"接続しました(", static_cast<int32>(getConnectTime().count() * 1000), U"ミリ秒)");
+
+            // ロビーで見えている部屋に空きがあれば、サーバーに探してもらわずに直接参加する
+            if (const auto room = getRoomIndex().findBestRoom(getRoomIndex().makeKey(getData().GetCustomProperties(), 2))) {
+                JoinRoom(room->name);
+                return;
+            }
+
+            JoinRandomRoom(getData().GetCustomProperties(), 2);   // 第2引数でルームに参加できる人数を設定します。
         }
 
         void DisconnectReturn() override {
@@ -136,6 +150,20 @@ namespace Sample {
             //changeScene(Common::Scene::Game);  // ゲームシーンに進む
         }
 
+        void JoinRoomReturn(int localPlayerNr,
+            const ExitGames::Common::Hashtable& roomProperties,
+            const ExitGames::Common::Hashtable& playerProperties,
+            int errorCode,
+            const ExitGames::Common::JString& errorString) override {
+            // 一覧を受け取った後に埋まった場合などは、サーバーに探してもらう
+            if (errorCode) {
+                JoinRandomRoom(getData().GetCustomProperties(), 2);
+                return;
+            }
+
+            s3d::Print(U"部屋に接続しました!");
+        }
+
         void JoinRoomEventAction(int playerNr, const ExitGames::Common::JVector<int>& playernrs, const ExitGames::LoadBalancing::Player& player) override {
             // 部屋に入室したのが自分の場合、早期リターン
             if (GetClient().getLocalPlayer().getNumber() == player.getNumber()) {
@@ -148,10 +176,29 @@ namespace Sample {
         }
 
         void LeaveRoomEventAction(int playerNr, bool isInactive) override {
+            // 対戦相手の通信が一時的に切れただけなら、再入室を待つ
+            if (isInactive) {
+                s3d::Print(U"対戦相手の再接続を待っています...");
+                return;
+            }
+
             s3d::Print(U"対戦相手が退室しました。");
             changeScene(Common::Scene::Title);  // タイトルシーンに戻る
         }
 
+        void ReconnectingAction(int32 attempt, int32 delayMillisec) override {
+            s3d::Print(U"通信が切れました。", delayMillisec, U"ミリ秒後に再接続します...(", attempt, U"回目)");
+        }
+
+        void ReconnectReturn(int errorCode, const s3d::Duration& recoveryTime) override {
+            if (errorCode) {
+                s3d::Print(U"再接続出来ませんでした");
+                return;
+            }
+
+            s3d::Print(U"再接続しました(", static_cast<int32>(recoveryTime.count() * 1000), U"ミリ秒)");
+        }
+
         /// <summary>
         /// 今回はこの関数は必要ない(何も受信しない為)
         /// </summary>
@@ -191,6 +238,68 @@ namespace Sample {
     };
 }
 
+#ifdef PHOTONSAMPLE_CLIENT_POOL
+namespace Sample {
+    /// <summary>
+    /// ClientPool で動かす負荷試験用のボット
+    /// 接続して2人部屋に入り、毎ティック入力の代わりのイベントを送る
+    /// </summary>
+    class Bot : public Utility::ClientSession {
+    private:
+        int32 m_id;
+
+        int32 m_tick = 0;
+
+        bool m_inRoom = false;
+
+    public:
+        explicit Bot(int32 id) : m_id(id) {}
+
+        void Start() override {
+            GetClient().connect(ExitGames::LoadBalancing::AuthenticationValues().setUserID(ExitGames::Common::JString(L"bot") + m_id));
+        }
+
+        void UpdatePhoton() override {
+            if (m_inRoom) {
+                GetClient().opRaiseEvent(false, ExitGames::Common::ValueObject<int32>(++m_tick), 1);
+            }
+        }
+
+        void ConnectReturn(int errorCode, const ExitGames::Common::JString&, const ExitGames::Common::JString&, const ExitGames::Common::JString&) override {
+            if (errorCode) {
+                finish();
+                return;
+            }
+
+            GetClient().opJoinRandomRoom(ExitGames::Common::Hashtable(), 2);
+        }
+
+        void JoinRandomRoomReturn(int, const ExitGames::Common::Hashtable&, const ExitGames::Common::Hashtable&, int errorCode, const ExitGames::Common::JString&) override {
+            // 空いている部屋が無ければ作る
+            if (errorCode) {
+                GetClient().opCreateRoom(L"", ExitGames::LoadBalancing::RoomOptions().setMaxPlayers(2));
+                return;
+            }
+
+            m_inRoom = true;
+        }
+
+        void CreateRoomReturn(int, const ExitGames::Common::Hashtable&, const ExitGames::Common::Hashtable&, int errorCode, const ExitGames::Common::JString&) override {
+            if (errorCode) {
+                finish();
+                return;
+            }
+
+            m_inRoom = true;
+        }
+
+        void DisconnectReturn() override {
+            finish();
+        }
+    };
+}
+#endif
+
 void Main() {
     // タイトルを設定
     s3d::Window::SetTitle(U"Photonサンプル");
@@ -205,16 +314,93 @@ void Main() {
     s3d::FontAsset::Register(U"Title", 120, s3d::Typeface::Heavy);
     s3d::FontAsset::Register(U"Menu", 30, s3d::Typeface::Regular);
 
+#ifdef PHOTONSAMPLE_BENCHMARK
+    // ベンチマークを実行して結果を書き出し、終了する（通信は行わない）。Benchmark 構成でビルドした場合に実行される
+    Utility::RunBenchmarks<Common::Scene, Common::GameData>(Common::Scene::Title, Common::Scene::Match, U"BenchmarkResult.json");
+    return;
+#endif
+
+#ifdef PHOTONSAMPLE_CLIENT_POOL
+    // ボットをまとめて動かし、処理量を表示し続ける（シーンは使わない）
+    {
+        Utility::ClientPool<Sample::Bot> pool(L"/*ここにPhotonのappIDを入力してください。*/", L"1.0");
+
+        for (int32 i = 0; i < 200; ++i) {
+            pool.add(i);
+        }
+
+        pool.start();
+
+        while (s3d::System::Update()) {
+            const Utility::ClientPoolStats stats = pool.getStats();
+
+            s3d::ClearPrint();
+            s3d::Print(U"セッション: ", stats.sessions, U", ワーカー: ", stats.workers);
+            s3d::Print(U"ティック/秒: ", stats.ticksPerSecond, U", 1ワーカーあたりの service()/秒: ", stats.servicesPerSecondPerWorker);
+            s3d::Print(U"間に合わなかったティック: ", stats.overruns);
+        }
+
+        pool.stop();
+    }
+    return;
+#endif
+
     // シーンと遷移時の色を設定
-    MyScene manager(L"/*ここにPhotonのappIDを入力してください。*/", L"1.0");
+    MyScene manager(L"/*ここにPhotonのappIDを入力してください。*/", L"1.0", ExitGames::LoadBalancing::RegionSelectionMode::SELECT);
 
     manager.add<Sample::Title>(Common::Scene::Title)
         .add<Sample::Match>(Common::Scene::Match)
-        .setFadeColor(s3d::ColorF(1.0));
+        .setFadeColor(s3d::ColorF(1.0))
+        .setRegionCache(U"RegionCache.txt")  // 一番速い地域を記録しておき、次回からはすぐに接続する
+        .setRoomIndexKey(L"gameType")
+        .setEventCompression(512)  // 512バイト以上のイベントは圧縮して送る
+        .setTrafficStatsEnabled(true);
+
+    // 通信は30Hzで行う。ウィンドウが裏にある間はフレームレートを下げるが、通信の30Hzは保つ（最小化中は描画しない）
+    Utility::FrameRateSettings frameRates;
+    frameRates.networkHz = 30.0;
+    frameRates.backgroundHz = 10.0;
+    manager.setFrameRates(frameRates);
+
+    // 通信量を5秒ごとにファイルに書き出す
+    manager.getTrafficMonitor()->setExport(U"PhotonTraffic.prom");
+
+    // 通信のコールバックと Photon のデバッグ出力をファイルに書き出す
+    Utility::Logger::Get().open(U"PhotonSample.log");
+    manager.GetClient().setDebugOutputLevel(ExitGames::Common::DebugLevel::INFO);
 
     while (s3d::System::Update()) {
+        // F1キーで通信量のグラフを表示する
+        if (s3d::KeyF1.down()) {
+            manager.getTrafficMonitor()->setOverlayVisible(!manager.getTrafficMonitor()->isOverlayVisible());
+        }
+
+        // F2キーで再現する通信環境を切り替える
+        if (s3d::KeyF2.down()) {
+            const auto preset = static_cast<Utility::NetworkPreset>((static_cast<int32>(manager.getNetworkSimulator().getPreset()) + 1) % (static_cast<int32>(Utility::NetworkPreset::Terrible) + 1));
+
+            manager.setNetworkPreset(preset);
+
+            const auto& conditions = manager.getNetworkSimulator().getConditions();
+            s3d::Print(U"通信環境: ", conditions.latencyMillisec, U"ms, ロス", conditions.lossRate * 100, U"%");
+        }
+
+        // F3キーで1秒あたりの描画と通信の回数を表示する
+        if (s3d::KeyF3.down()) {
+            const auto& stats = manager.getFrameRateStats();
+            s3d::Print(U"fps: ", stats.frames, U", 描画: ", stats.draws, U", 更新: ", stats.updates, U", 通信: ", stats.services, U", 処理: ", stats.busy * 100, U"%");
+        }
+
+        // F4キーで前のフレームのメモリ確保の回数を表示する（全体の回数は PHOTONSAMPLE_COUNT_ALLOCATIONS を定義した場合のみ）
+        if (s3d::KeyF4.down()) {
+            s3d::Print(U"確保: シーン ", manager.getSceneAllocationStats().allocations, U", フレーム ", manager.getFrameAllocationStats().allocations, U", 全体 ", manager.getGlobalAllocationStats().allocations);
+        }
+
         if (!manager.update()) {
             break;
         }
     }
+
+    // 書き出し待ちのログを書き出してから終了する
+    Utility::Logger::Get().close();
 }
@@ -0,0 +1,394 @@
+﻿#pragma once
+#define NO_S3D_USING
+#include <Siv3D.hpp>  // OpenSiv3D v0.4.3
+#include <LoadBalancing-cpp/inc/Client.h>
+#include <bitset>
+#include <queue>
+#include <random>
+
+namespace Utility {
+    enum class JitterDistribution {
+        Uniform,  // -jitter ～ +jitter の一様分布
+
+        Normal,  // 標準偏差 jitter の正規分布
+    };
+
+    /// <summary>
+    /// 再現したい通信環境（片方向）
+    /// </summary>
+    struct NetworkConditions {
+        s3d::int32 latencyMillisec = 0;
+
+        s3d::int32 jitterMillisec = 0;
+
+        JitterDistribution jitterDistribution = JitterDistribution::Uniform;
+
+        // パケットが失われる確率（0 ～ 1）。信頼性のある通信では失われる代わりに再送の分だけ遅れます（最大 NetworkSimulator::MaxRetransmissions 回）。
+        double lossRate = 0.0;
+
+        // 信頼性の無い通信でパケットが重複する確率
+        double duplicateRate = 0.0;
+
+        // 信頼性の無い通信でパケットが後続のパケットに追い越される確率
+        double reorderRate = 0.0;
+
+        // 1秒間に送れるバイト数（0 の場合は制限なし）
+        s3d::int32 bandwidthBytesPerSec = 0;
+
+        [[nodiscard]] bool isPerfect() const noexcept {
+            return latencyMillisec <= 0 && jitterMillisec <= 0 && lossRate <= 0.0 && duplicateRate <= 0.0 && reorderRate <= 0.0 && bandwidthBytesPerSec <= 0;
+        }
+    };
+
+    enum class NetworkPreset {
+        Off,
+
+        LAN,
+
+        Broadband,
+
+        Mobile,
+
+        Bad,  // 200ms, 5% のロス
+
+        Terrible,
+    };
+
+    /// <summary>
+    /// プリセットの通信環境を取得します。
+    /// </summary>
+    /// <param name="preset">
+    /// プリセット
+    /// </param>
+    /// <returns>
+    /// 通信環境
+    /// </returns>
+    [[nodiscard]] inline NetworkConditions GetNetworkConditions(NetworkPreset preset) {
+        NetworkConditions conditions;
+
+        switch (preset) {
+        case NetworkPreset::LAN:
+            conditions.latencyMillisec = 2;
+            conditions.jitterMillisec = 1;
+            break;
+        case NetworkPreset::Broadband:
+            conditions.latencyMillisec = 25;
+            conditions.jitterMillisec = 5;
+            conditions.lossRate = 0.001;
+            break;
+        case NetworkPreset::Mobile:
+            conditions.latencyMillisec = 80;
+            conditions.jitterMillisec = 30;
+            conditions.jitterDistribution = JitterDistribution::Normal;
+            conditions.lossRate = 0.02;
+            conditions.reorderRate = 0.01;
+            conditions.bandwidthBytesPerSec = 64 * 1024;
+            break;
+        case NetworkPreset::Bad:
+            conditions.latencyMillisec = 200;
+            conditions.jitterMillisec = 50;
+            conditions.jitterDistribution = JitterDistribution::Normal;
+            conditions.lossRate = 0.05;
+            conditions.duplicateRate = 0.01;
+            conditions.reorderRate = 0.02;
+            conditions.bandwidthBytesPerSec = 32 * 1024;
+            break;
+        case NetworkPreset::Terrible:
+            conditions.latencyMillisec = 400;
+            conditions.jitterMillisec = 150;
+            conditions.jitterDistribution = JitterDistribution::Normal;
+            conditions.lossRate = 0.15;
+            conditions.duplicateRate = 0.03;
+            conditions.reorderRate = 0.05;
+            conditions.bandwidthBytesPerSec = 8 * 1024;
+            break;
+        default:
+            break;
+        }
+
+        return conditions;
+    }
+
+    /// <summary>
+    /// 遅延・ゆらぎ・ロス・重複・順序の入れ替わり・帯域制限を再現する
+    /// </summary>
+    /// <remarks>
+    /// 受信したコールバックや送信する操作を関数として受け取り、再現した到着時刻に update() で呼び出します。
+    /// 乱数はシードから決まるので、同じ操作の列に対しては同じ結果になります。
+    /// </remarks>
+    class NetworkSimulator : s3d::Uncopyable {
+    public:
+        enum class Direction {
+            Incoming,
+
+            Outgoing,
+        };
+
+        struct Stats {
+            s3d::uint64 delivered = 0;
+
+            s3d::uint64 dropped = 0;
+
+            s3d::uint64 duplicated = 0;
+
+            s3d::uint64 reordered = 0;
+
+            s3d::uint64 retransmitted = 0;
+        };
+
+        // 信頼性のある通信を再送する最大回数。lossRate が 1 の場合もこの回数の分だけ遅れて届く
+        static constexpr s3d::int32 MaxRetransmissions = 7;
+
+    private:
+        struct Packet {
+            double deliverAt;
+
+            s3d::uint64 sequence;
+
+            std::function<void()> deliver;
+        };
+
+        struct Later {
+            bool operator()(const Packet& a, const Packet& b) const noexcept {
+                return (a.deliverAt != b.deliverAt) ? (a.deliverAt > b.deliverAt) : (a.sequence > b.sequence);
+            }
+        };
+
+        struct Channel {
+            std::priority_queue<Packet, std::vector<Packet>, Later> queue;
+
+            // 信頼性のある通信の順序を保つため、最後に届ける時刻を覚えておく
+            double lastReliableAt = 0.0;
+
+            // 帯域制限で、前のパケットを送り終わる時刻
+            double busyUntil = 0.0;
+        };
+
+        NetworkConditions m_conditions;
+
+        NetworkPreset m_preset = NetworkPreset::Off;
+
+        std::mt19937_64 m_rng;
+
+        s3d::Stopwatch m_clock{ true };
+
+        s3d::uint64 m_sequence = 0;
+
+        std::array<Channel, 2> m_channels;
+
+        // 信頼性の無い通信で送られてくるイベントコード
+        std::bitset<256> m_unreliableEventCodes;
+
+        bool m_enabled = false;
+
+        Stats m_stats;
+
+        [[nodiscard]] double random01() {
+            return std::uniform_real_distribution<double>(0.0, 1.0)(m_rng);
+        }
+
+        [[nodiscard]] double sampleDelay() {
+            double jitter = 0.0;
+
+            if (m_conditions.jitterMillisec > 0) {
+                if (m_conditions.jitterDistribution == JitterDistribution::Normal) {
+                    jitter = std::normal_distribution<double>(0.0, m_conditions.jitterMillisec)(m_rng);
+                }
+                else {
+                    jitter = std::uniform_real_distribution<double>(-m_conditions.jitterMillisec, m_conditions.jitterMillisec)(m_rng);
+                }
+            }
+
+            return s3d::Max(0.0, m_conditions.latencyMillisec + jitter);
+        }
+
+        void push(Channel& channel, const double deliverAt, std::function<void()> deliver) {
+            channel.queue.push({ deliverAt, m_sequence++, std::move(deliver) });
+        }
+
+        void deliverUntil(Channel& channel, const double time) {
+            while (!channel.queue.empty() && channel.queue.top().deliverAt <= time) {
+                // 届けた関数が新しいパケットを積むことがあるので、先に取り出しておく
+                std::function<void()> deliver = std::move(const_cast<Packet&>(channel.queue.top()).deliver);
+
+                channel.queue.pop();
+
+                ++m_stats.delivered;
+
+                deliver();
+            }
+        }
+
+    public:
+        /// <param name="seed">
+        /// 乱数のシード
+        /// </param>
+        explicit NetworkSimulator(s3d::uint64 seed = 0) : m_rng(seed) {}
+
+        /// <summary>
+        /// 通信環境を設定します。遅延などが無い環境を設定した場合は、溜まっているパケットを全て届けて無効になります。
+        /// </summary>
+        /// <param name="conditions">
+        /// 通信環境
+        /// </param>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void setConditions(const NetworkConditions& conditions) {
+            m_conditions = conditions;
+
+            m_conditions.lossRate = s3d::Clamp(conditions.lossRate, 0.0, 1.0);
+
+            m_enabled = !conditions.isPerfect();
+
+            if (!m_enabled) {
+                flush();
+            }
+        }
+
+        [[nodiscard]] const NetworkConditions& getConditions() const noexcept {
+            return m_conditions;
+        }
+
+        void setPreset(NetworkPreset preset) {
+            m_preset = preset;
+
+            setConditions(GetNetworkConditions(preset));
+        }
+
+        [[nodiscard]] NetworkPreset getPreset() const noexcept {
+            return m_preset;
+        }
+
+        /// <summary>
+        /// 乱数のシードを設定し直します。
+        /// </summary>
+        void setSeed(s3d::uint64 seed) {
+            m_rng.seed(seed);
+        }
+
+        /// <summary>
+        /// イベントコードごとに、信頼性のある通信で送られてくるかを設定します。既定では全て信頼性のある通信として扱います。
+        /// </summary>
+        void setEventReliable(nByte eventCode, bool reliable) {
+            m_unreliableEventCodes[eventCode] = !reliable;
+        }
+
+        [[nodiscard]] bool isEventReliable(nByte eventCode) const {
+            return !m_unreliableEventCodes[eventCode];
+        }
+
+        [[nodiscard]] bool isEnabled() const noexcept {
+            return m_enabled;
+        }
+
+        [[nodiscard]] bool isBandwidthLimited() const noexcept {
+            return m_enabled && m_conditions.bandwidthBytesPerSec > 0;
+        }
+
+        [[nodiscard]] const Stats& getStats() const noexcept {
+            return m_stats;
+        }
+
+        /// <summary>
+        /// パケットの到着を予約します。
+        /// </summary>
+        /// <param name="direction">
+        /// 受信か送信か
+        /// </param>
+        /// <param name="bytes">
+        /// パケットの大きさ（帯域制限に使う）
+        /// </param>
+        /// <param name="reliable">
+        /// 信頼性のある通信か。信頼性のある通信は失われず、順序も入れ替わりません。
+        /// </param>
+        /// <param name="deliver">
+        /// 到着した時に呼ぶ関数
+        /// </param>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void schedule(Direction direction, size_t bytes, bool reliable, std::function<void()> deliver) {
+            Channel& channel = m_channels[static_cast<size_t>(direction)];
+
+            double sendAt = m_clock.msF();
+
+            if (m_conditions.bandwidthBytesPerSec > 0) {
+                sendAt = s3d::Max(sendAt, channel.busyUntil);
+
+                channel.busyUntil = sendAt + bytes * 1000.0 / m_conditions.bandwidthBytesPerSec;
+            }
+
+            if (reliable) {
+                double deliverAt = sendAt + sampleDelay();
+
+                // 失われたパケットは、届かなかったことが分かって再送されるまで遅れる
+                for (s3d::int32 i = 0; i < MaxRetransmissions && random01() < m_conditions.lossRate; ++i) {
+                    ++m_stats.retransmitted;
+
+                    deliverAt += sampleDelay() * 2;
+                }
+
+                deliverAt = s3d::Max(deliverAt, channel.lastReliableAt);
+
+                channel.lastReliableAt = deliverAt;
+
+                push(channel, deliverAt, std::move(deliver));
+
+                return;
+            }
+
+            if (random01() < m_conditions.lossRate) {
+                ++m_stats.dropped;
+                return;
+            }
+
+            double deliverAt = sendAt + sampleDelay();
+
+            // 後から送ったパケットに追い越されるよう、さらに遅らせる
+            if (random01() < m_conditions.reorderRate) {
+                ++m_stats.reordered;
+
+                deliverAt += sampleDelay() + 1.0;
+            }
+
+            if (random01() < m_conditions.duplicateRate) {
+                ++m_stats.duplicated;
+
+                push(channel, deliverAt + sampleDelay() * 0.1, deliver);
+            }
+
+            push(channel, deliverAt, std::move(deliver));
+        }
+
+        /// <summary>
+        /// 到着時刻になったパケットを届けます。
+        /// </summary>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void update() {
+            const double now = m_clock.msF();
+
+            for (auto& channel : m_channels) {
+                deliverUntil(channel, now);
+            }
+        }
+
+        /// <summary>
+        /// 溜まっているパケットを到着時刻の順に全て届けます。
+        /// </summary>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void flush() {
+            for (auto& channel : m_channels) {
+                deliverUntil(channel, std::numeric_limits<double>::infinity());
+
+                channel.lastReliableAt = 0.0;
+
+                channel.busyUntil = 0.0;
+            }
+        }
+    };
+}  // namespace Utility
@@ -0,0 +1,256 @@
+﻿#pragma once
+#define NO_S3D_USING
+#include <Siv3D.hpp>  // OpenSiv3D v0.4.3
+#include <LoadBalancing-cpp/inc/Client.h>
+
+namespace Utility {
+    /// <summary>
+    /// 部屋やプレイヤーのカスタムプロパティの同期
+    /// </summary>
+    /// <remarks>
+    /// set() した値はすぐに get() で読めるようになり、変更されたキーは次の flush() でまとめて送られます。
+    /// 同じキーを何度変更しても、送るのは最後の値だけです。
+    /// 他の人と取り合うキーは compareAndSet() で、サーバーの値が期待した値の場合だけ書き換えます。
+    /// 同じキーへの set() と compareAndSet() は、呼ばれた順にサーバーに届きます。
+    /// </remarks>
+    class PropertyStore {
+    public:
+        struct Stats {
+            // set() の回数
+            s3d::uint64 writes = 0;
+
+            // 送る前に上書きされてまとめられた set() の回数
+            s3d::uint64 coalescedWrites = 0;
+
+            // 送ったメッセージの数（compareAndSet() の分を含む）
+            s3d::uint64 messages = 0;
+
+            s3d::uint64 sentKeys = 0;
+
+            s3d::uint64 checkAndSwaps = 0;
+
+            // 受け取って反映した変更の数
+            s3d::uint64 appliedChanges = 0;
+        };
+
+    private:
+        // 1回で送る変更
+        struct Batch {
+            ExitGames::Common::Hashtable properties;
+
+            // compareAndSet() の場合だけ、期待するサーバーの値を持つ
+            ExitGames::Common::Hashtable expected;
+
+            [[nodiscard]] bool isCheckAndSwap() const {
+                return expected.getSize() > 0;
+            }
+        };
+
+        ExitGames::Common::Hashtable m_values;
+
+        // 次の flush() で送る変更（呼ばれた順）
+        s3d::Array<Batch> m_batches;
+
+        /// <summary>
+        /// 送っていない set() の変更にキーが含まれているかを返す
+        /// </summary>
+        template<class Key>
+        [[nodiscard]] bool isPending(const Key& key) const {
+            for (const auto& batch : m_batches) {
+                if (!batch.isCheckAndSwap() && batch.properties.contains(key)) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        Stats m_stats;
+
+    public:
+        /// <summary>
+        /// 値を設定し、次の flush() で送るようにします。
+        /// </summary>
+        /// <param name="key">
+        /// キー
+        /// </param>
+        /// <param name="value">
+        /// 値
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        template<class Key, class Value>
+        PropertyStore& set(const Key& key, const Value& value) {
+            ++m_stats.writes;
+
+            m_values.put(key, value);
+
+            // 同じキーの compareAndSet() より前にはまとめない
+            for (auto it = m_batches.rbegin(); it != m_batches.rend(); ++it) {
+                if (it->isCheckAndSwap()) {
+                    if (it->properties.contains(key)) {
+                        break;
+                    }
+
+                    continue;
+                }
+
+                if (it->properties.contains(key)) {
+                    ++m_stats.coalescedWrites;
+                }
+
+                it->properties.put(key, value);
+
+                return *this;
+            }
+
+            Batch batch;
+
+            batch.properties.put(key, value);
+
+            m_batches.push_back(std::move(batch));
+
+            return *this;
+        }
+
+        /// <summary>
+        /// サーバーの値が expected の場合だけ値を書き換えます。
+        /// </summary>
+        /// <remarks>
+        /// 書き換えが成功したかどうかはサーバーからの変更の通知で分かるので、get() の値はそれまで変わりません。
+        /// </remarks>
+        /// <param name="key">
+        /// キー
+        /// </param>
+        /// <param name="value">
+        /// 新しい値
+        /// </param>
+        /// <param name="expected">
+        /// 期待するサーバーの値
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        template<class Key, class Value, class Expected>
+        PropertyStore& compareAndSet(const Key& key, const Value& value, const Expected& expected) {
+            Batch batch;
+
+            batch.properties.put(key, value);
+            batch.expected.put(key, expected);
+
+            m_batches.push_back(std::move(batch));
+
+            return *this;
+        }
+
+        /// <summary>
+        /// 値を取得します。
+        /// </summary>
+        /// <returns>
+        /// キーが無い場合は nullptr
+        /// </returns>
+        template<class Key>
+        [[nodiscard]] const ExitGames::Common::Object* get(const Key& key) const {
+            return m_values.getValue(key);
+        }
+
+        [[nodiscard]] const ExitGames::Common::Hashtable& getAll() const noexcept {
+            return m_values;
+        }
+
+        /// <summary>
+        /// サーバーから届いた変更を反映します。変更されたキーだけを書き換えます。
+        /// </summary>
+        /// <param name="changes">
+        /// 変更されたキーと値（値が null のキーは削除）
+        /// </param>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void apply(const ExitGames::Common::Hashtable& changes) {
+            const ExitGames::Common::JVector<ExitGames::Common::Object>& keys = changes.getKeys();
+
+            for (unsigned int i = 0; i < keys.getSize(); ++i) {
+                // 送っていない自分の変更の方が新しい
+                if (isPending(keys[i])) {
+                    continue;
+                }
+
+                const ExitGames::Common::Object* value = changes.getValue(keys[i]);
+
+                if (!value || value->getType() == ExitGames::Common::TypeCode::EG_NULL) {
+                    m_values.remove(keys[i]);
+                }
+                else {
+                    m_values.put(keys[i], *value);
+                }
+
+                ++m_stats.appliedChanges;
+            }
+        }
+
+        /// <summary>
+        /// 送っていない変更があるかを返します。
+        /// </summary>
+        [[nodiscard]] bool isDirty() const noexcept {
+            return !m_batches.isEmpty();
+        }
+
+        /// <summary>
+        /// 溜まった変更を送ります。同じキーについては、set() と compareAndSet() が呼ばれた順に送ります。
+        /// </summary>
+        /// <param name="setProperties">
+        /// (const Hashtable& properties, const Hashtable& expectedProperties) を受け取って送る関数
+        /// </param>
+        /// <returns>
+        /// なし
+        /// </returns>
+        template<class Function>
+        void flush(Function setProperties) {
+            for (const auto& batch : m_batches) {
+                ++m_stats.messages;
+                m_stats.sentKeys += batch.properties.getSize();
+
+                if (batch.isCheckAndSwap()) {
+                    ++m_stats.checkAndSwaps;
+                }
+
+                setProperties(batch.properties, batch.expected);
+            }
+
+            m_batches.clear();
+        }
+
+        /// <summary>
+        /// 値と送っていない変更を全て消します。
+        /// </summary>
+        void clear() {
+            m_values = ExitGames::Common::Hashtable();
+            m_batches.clear();
+        }
+
+        /// <summary>
+        /// 値を全て置き換えます。送っていない変更は残ります。
+        /// </summary>
+        void reset(const ExitGames::Common::Hashtable& values) {
+            m_values = values;
+
+            for (const auto& batch : m_batches) {
+                if (batch.isCheckAndSwap()) {
+                    continue;
+                }
+
+                const ExitGames::Common::JVector<ExitGames::Common::Object>& keys = batch.properties.getKeys();
+
+                for (unsigned int i = 0; i < keys.getSize(); ++i) {
+                    m_values.put(keys[i], *batch.properties.getValue(keys[i]));
+                }
+            }
+        }
+
+        [[nodiscard]] const Stats& getStats() const noexcept {
+            return m_stats;
+        }
+    };
+}  // namespace Utility
@@ -0,0 +1,251 @@
+﻿#pragma once
+#define NO_S3D_USING
+#include <Siv3D.hpp>  // OpenSiv3D v0.4.3
+#include <LoadBalancing-cpp/inc/Client.h>
+#include <atomic>
+
+namespace Utility {
+    /// <summary>
+    /// 地域ごとの応答時間を計測し、最も速い地域を選ぶ
+    /// </summary>
+    /// <remarks>
+    /// 計測結果はファイルに保存し、有効期限内であれば次回の起動時は計測を待たずにその地域へ接続します。
+    /// その場合も計測はバックグラウンドで続け、結果でキャッシュを更新します。
+    /// 計測中に start() された場合は計測をやり直さず、続いている計測の結果を使います。
+    /// </remarks>
+    class RegionSelector : s3d::Uncopyable {
+    public:
+        struct Result {
+            s3d::String region;
+
+            s3d::int32 pingMillisec;
+        };
+
+    private:
+        struct Probe {
+            s3d::String region;
+
+            s3d::ConcurrentTask<s3d::Optional<s3d::int32>> task;
+        };
+
+        s3d::FilePath m_cachePath;
+
+        s3d::int64 m_ttlSec;
+
+        // 1地域あたりの計測回数（最小値を採用する）
+        s3d::int32 m_samples = 3;
+
+        s3d::int32 m_timeoutMillisec = 2000;
+
+        // 破棄する時に計測を打ち切る（m_probes より先に宣言し、計測の終了を待つ間は残す）
+        std::atomic<bool> m_stop{ false };
+
+        s3d::Array<Probe> m_probes;
+
+        s3d::Optional<Result> m_best;
+
+        /// <summary>
+        /// "ip:port" 形式のアドレスから IPv4 アドレスを取り出す
+        /// </summary>
+        [[nodiscard]] static s3d::Optional<s3d::IPv4> ParseAddress(const s3d::String& address) {
+            const s3d::Array<s3d::String> parts = address.split(U':').front().split(U'.');
+
+            if (parts.size() != 4) {
+                return s3d::none;
+            }
+
+            std::array<s3d::uint8, 4> bytes;
+
+            for (size_t i = 0; i < 4; ++i) {
+                const auto value = s3d::ParseIntOpt<s3d::uint8>(parts[i]);
+
+                if (!value) {
+                    return s3d::none;
+                }
+
+                bytes[i] = *value;
+            }
+
+            return s3d::IPv4(bytes[0], bytes[1], bytes[2], bytes[3]);
+        }
+
+        /// <summary>
+        /// TCP の接続にかかる時間(1往復)を計測する。計測用のスレッドで実行されます。
+        /// </summary>
+        [[nodiscard]] static s3d::Optional<s3d::int32> Measure(const s3d::IPv4 ip, const s3d::int32 samples, const s3d::int32 timeoutMillisec, const std::atomic<bool>* stop) {
+            // Photon のマスターサーバーの TCP ポート
+            constexpr s3d::uint16 port = 4530;
+
+            s3d::Optional<s3d::int32> best;
+
+            for (s3d::int32 i = 0; i < samples && !stop->load(std::memory_order_relaxed); ++i) {
+                s3d::TCPClient client;
+
+                s3d::Stopwatch stopwatch(true);
+
+                client.connect(ip, port);
+
+                while (!client.isConnected() && !client.hasError() && stopwatch.ms() < timeoutMillisec && !stop->load(std::memory_order_relaxed)) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+
+                if (client.isConnected()) {
+                    const s3d::int32 ping = stopwatch.ms();
+
+                    best = best ? s3d::Min(*best, ping) : ping;
+                }
+
+                client.disconnect();
+            }
+
+            return best;
+        }
+
+        [[nodiscard]] s3d::Optional<Result> loadCache() const {
+            s3d::TextReader reader(m_cachePath);
+
+            if (!reader) {
+                return s3d::none;
+            }
+
+            // 地域 応答時間 保存時刻(UNIX時間)
+            const s3d::Array<s3d::String> values = reader.readAll().trimmed().split(U' ');
+
+            if (values.size() != 3) {
+                return s3d::none;
+            }
+
+            const auto ping = s3d::ParseIntOpt<s3d::int32>(values[1]);
+            const auto savedAt = s3d::ParseIntOpt<s3d::int64>(values[2]);
+
+            if (!ping || !savedAt || (s3d::Time::GetSecSinceEpoch() - *savedAt) > m_ttlSec) {
+                return s3d::none;
+            }
+
+            return Result{ values[0], *ping };
+        }
+
+        void saveCache(const Result& result) const {
+            s3d::TextWriter writer(m_cachePath);
+
+            if (writer) {
+                writer.writeln(result.region, U' ', result.pingMillisec, U' ', s3d::Time::GetSecSinceEpoch());
+            }
+        }
+
+    public:
+        /// <summary>
+        /// 地域の選択を初期化します。
+        /// </summary>
+        /// <param name="cachePath">
+        /// 計測結果を保存するファイル
+        /// </param>
+        /// <param name="ttl">
+        /// 保存した結果の有効期限
+        /// </param>
+        RegionSelector(const s3d::FilePath& cachePath, const s3d::Duration& ttl)
+            : m_cachePath(cachePath), m_ttlSec(static_cast<s3d::int64>(ttl.count())) {}
+
+        ~RegionSelector() {
+            // 計測中のタスクの破棄は終了を待つので、先に打ち切らせる
+            m_stop.store(true, std::memory_order_relaxed);
+        }
+
+        /// <summary>
+        /// 各地域の計測を並列に開始します。計測中の場合は開始せず、キャッシュだけを確認します。
+        /// </summary>
+        /// <param name="regions">
+        /// 接続可能な地域
+        /// </param>
+        /// <param name="servers">
+        /// 各地域のサーバーのアドレス
+        /// </param>
+        /// <returns>
+        /// キャッシュが有効な場合はその地域、それ以外の場合は none
+        /// </returns>
+        s3d::Optional<s3d::String> start(const ExitGames::Common::JVector<ExitGames::Common::JString>& regions,
+                                         const ExitGames::Common::JVector<ExitGames::Common::JString>& servers) {
+            s3d::Optional<s3d::String> cachedRegion;
+
+            const auto cache = loadCache();
+
+            // 終わっていない計測を破棄すると終了を待つことになるので、そのまま続けさせる
+            const bool measuring = isMeasuring();
+
+            if (!measuring) {
+                m_best.reset();
+            }
+
+            for (unsigned int i = 0; i < regions.getSize(); ++i) {
+                const s3d::String region = s3d::Unicode::FromWString(std::wstring(regions[i]));
+
+                if (cache && cache->region == region) {
+                    cachedRegion = region;
+                }
+
+                if (measuring) {
+                    continue;
+                }
+
+                const auto ip = ParseAddress(s3d::Unicode::FromWString(std::wstring(servers[i])));
+
+                // アドレスが IPv4 でない地域は計測できないので候補から外す
+                if (!ip) {
+                    continue;
+                }
+
+                m_probes.push_back({ region, s3d::CreateConcurrentTask(&RegionSelector::Measure, *ip, m_samples, m_timeoutMillisec, &m_stop) });
+            }
+
+            return cachedRegion;
+        }
+
+        /// <summary>
+        /// 計測の終了を確認します。
+        /// </summary>
+        /// <returns>
+        /// 今回の呼び出しで全ての計測が終わった場合 true, それ以外の場合は false
+        /// </returns>
+        bool update() {
+            if (m_probes.isEmpty()) {
+                return false;
+            }
+
+            for (const auto& probe : m_probes) {
+                if (!probe.task.is_done()) {
+                    return false;
+                }
+            }
+
+            for (auto& probe : m_probes) {
+                const auto ping = probe.task.get();
+
+                if (ping && (!m_best || *ping < m_best->pingMillisec)) {
+                    m_best = Result{ probe.region, *ping };
+                }
+            }
+
+            m_probes.clear();
+
+            if (m_best) {
+                saveCache(*m_best);
+            }
+
+            return true;
+        }
+
+        [[nodiscard]] bool isMeasuring() const noexcept {
+            return !m_probes.isEmpty();
+        }
+
+        /// <summary>
+        /// 最後の計測で最も速かった地域を取得します。
+        /// </summary>
+        /// <returns>
+        /// 計測できた地域が無い場合は none
+        /// </returns>
+        [[nodiscard]] const s3d::Optional<Result>& getBest() const noexcept {
+            return m_best;
+        }
+    };
+}  // namespace Utility
@@ -0,0 +1,302 @@
+﻿#pragma once
+#define NO_S3D_USING
+#include <Siv3D.hpp>  // OpenSiv3D v0.4.3
+#include <LoadBalancing-cpp/inc/Client.h>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+namespace Utility {
+    /// <summary>
+    /// 部屋を探す条件。RoomIndex::makeKey() で作り、同じ条件で何度も探す場合は使い回してください。
+    /// </summary>
+    struct RoomKey {
+        // 索引に使うカスタムプロパティの値のハッシュ
+        s3d::uint64 hash = 0;
+
+        nByte maxPlayers = 0;
+
+        [[nodiscard]] bool operator==(const RoomKey& other) const noexcept {
+            return hash == other.hash && maxPlayers == other.maxPlayers;
+        }
+    };
+
+    /// <summary>
+    /// ロビーから見える部屋の情報
+    /// </summary>
+    struct RoomEntry {
+        ExitGames::Common::JString name;
+
+        // 索引に使うカスタムプロパティの値（プロパティが無い場合は空）
+        std::wstring key;
+
+        // key のハッシュ
+        s3d::uint64 keyHash = 0;
+
+        nByte playerCount = 0;
+
+        nByte maxPlayers = 0;
+
+        bool isOpen = true;
+
+        // 空きの数（最大人数の制限が無い場合は大きな値）
+        [[nodiscard]] s3d::int32 freeSlots() const noexcept {
+            return maxPlayers ? static_cast<s3d::int32>(maxPlayers) - playerCount : 0xFF;
+        }
+    };
+
+    /// <summary>
+    /// ロビーの部屋の一覧の索引
+    /// </summary>
+    /// <remarks>
+    /// 部屋はカスタムプロパティの値のハッシュと最大人数でまとめ、その中で空きの数の順に並べます。
+    /// 一覧が更新されたときは、変わった部屋だけ索引を付け直します。
+    /// 値は 64 ビットのハッシュで比べるので、違う値が同じグループになることは実際上ありません。
+    /// </remarks>
+    class RoomIndex : s3d::Uncopyable {
+    private:
+        struct RoomKeyHash {
+            [[nodiscard]] size_t operator()(const RoomKey& key) const noexcept {
+                return static_cast<size_t>(key.hash ^ (key.maxPlayers * 0x9E3779B97F4A7C15ull));
+            }
+        };
+
+        // 空きの数 → 部屋（m_rooms の要素は再ハッシュされても動かない）
+        using Group = std::map<s3d::int32, std::set<const RoomEntry*>>;
+
+        ExitGames::Common::JString m_propertyKey;
+
+        std::unordered_map<std::wstring, RoomEntry> m_rooms;
+
+        std::unordered_map<RoomKey, Group, RoomKeyHash> m_groups;
+
+        // 一覧から消えた部屋を見つけるための印
+        std::unordered_map<std::wstring, s3d::uint64> m_seen;
+
+        s3d::uint64 m_generation = 0;
+
+        [[nodiscard]] std::wstring keyOf(const ExitGames::Common::Hashtable& properties) const {
+            const ExitGames::Common::Object* value = properties.getValue(m_propertyKey);
+
+            return value ? std::wstring(value->toString().cstr()) : std::wstring();
+        }
+
+        /// <summary>
+        /// FNV-1a
+        /// </summary>
+        [[nodiscard]] static s3d::uint64 Hash(const std::wstring& key) noexcept {
+            s3d::uint64 hash = 0xCBF29CE484222325ull;
+
+            for (const wchar_t ch : key) {
+                hash = (hash ^ static_cast<s3d::uint64>(ch)) * 0x100000001B3ull;
+            }
+
+            return hash;
+        }
+
+        void insertIndex(const RoomEntry& entry) {
+            if (!entry.isOpen || entry.freeSlots() <= 0) {
+                return;
+            }
+
+            m_groups[{ entry.keyHash, entry.maxPlayers }][entry.freeSlots()].insert(&entry);
+        }
+
+        void eraseIndex(const RoomEntry& entry) {
+            const auto group = m_groups.find({ entry.keyHash, entry.maxPlayers });
+
+            if (group == m_groups.end()) {
+                return;
+            }
+
+            const auto slots = group->second.find(entry.freeSlots());
+
+            if (slots == group->second.end()) {
+                return;
+            }
+
+            slots->second.erase(&entry);
+
+            if (slots->second.empty()) {
+                group->second.erase(slots);
+            }
+
+            if (group->second.empty()) {
+                m_groups.erase(group);
+            }
+        }
+
+    public:
+        /// <param name="propertyKey">
+        /// 索引に使うカスタムプロパティのキー
+        /// </param>
+        explicit RoomIndex(const ExitGames::Common::JString& propertyKey = L"") : m_propertyKey(propertyKey) {}
+
+        /// <summary>
+        /// 索引に使うカスタムプロパティのキーを設定します。索引は空になります。
+        /// </summary>
+        void setPropertyKey(const ExitGames::Common::JString& propertyKey) {
+            m_propertyKey = propertyKey;
+
+            clear();
+        }
+
+        [[nodiscard]] const ExitGames::Common::JString& getPropertyKey() const noexcept {
+            return m_propertyKey;
+        }
+
+        /// <summary>
+        /// ロビーの部屋の一覧を取り込みます。
+        /// </summary>
+        /// <param name="rooms">
+        /// Client::getRoomList() の部屋の一覧
+        /// </param>
+        /// <returns>
+        /// 追加・変更・削除された部屋の数
+        /// </returns>
+        size_t update(const ExitGames::Common::JVector<ExitGames::LoadBalancing::Room*>& rooms) {
+            ++m_generation;
+
+            size_t changed = 0;
+
+            for (unsigned int i = 0; i < rooms.getSize(); ++i) {
+                const ExitGames::LoadBalancing::Room& room = *rooms[i];
+
+                const std::wstring name(room.getName().cstr());
+
+                m_seen[name] = m_generation;
+
+                RoomEntry entry;
+                entry.name = room.getName();
+                entry.key = keyOf(room.getCustomProperties());
+                entry.keyHash = Hash(entry.key);
+                entry.playerCount = room.getPlayerCount();
+                entry.maxPlayers = room.getMaxPlayers();
+                entry.isOpen = room.getIsOpen();
+
+                auto it = m_rooms.find(name);
+
+                if (it != m_rooms.end()) {
+                    RoomEntry& old = it->second;
+
+                    if (old.key == entry.key && old.playerCount == entry.playerCount && old.maxPlayers == entry.maxPlayers && old.isOpen == entry.isOpen) {
+                        continue;
+                    }
+
+                    eraseIndex(old);
+
+                    old = std::move(entry);
+                }
+                else {
+                    it = m_rooms.emplace(name, std::move(entry)).first;
+                }
+
+                insertIndex(it->second);
+
+                ++changed;
+            }
+
+            // 今回の一覧に無かった部屋を消す
+            for (auto it = m_seen.begin(); it != m_seen.end();) {
+                if (it->second == m_generation) {
+                    ++it;
+                    continue;
+                }
+
+                const auto room = m_rooms.find(it->first);
+
+                eraseIndex(room->second);
+
+                m_rooms.erase(room);
+
+                it = m_seen.erase(it);
+
+                ++changed;
+            }
+
+            return changed;
+        }
+
+        void clear() {
+            m_rooms.clear();
+            m_groups.clear();
+            m_seen.clear();
+        }
+
+        [[nodiscard]] size_t size() const noexcept {
+            return m_rooms.size();
+        }
+
+        /// <summary>
+        /// 部屋を名前で探します。
+        /// </summary>
+        /// <returns>
+        /// 見つからない場合は nullptr
+        /// </returns>
+        [[nodiscard]] const RoomEntry* find(const ExitGames::Common::JString& name) const {
+            const auto it = m_rooms.find(std::wstring(name.cstr()));
+
+            return (it != m_rooms.end()) ? &it->second : nullptr;
+        }
+
+        /// <summary>
+        /// 部屋を探す条件を作ります。
+        /// </summary>
+        /// <param name="properties">
+        /// 部屋に求めるカスタムプロパティ。索引のキーの値だけを使います。
+        /// </param>
+        /// <param name="maxPlayers">
+        /// 部屋の最大人数
+        /// </param>
+        /// <returns>
+        /// 部屋を探す条件
+        /// </returns>
+        [[nodiscard]] RoomKey makeKey(const ExitGames::Common::Hashtable& properties, nByte maxPlayers) const {
+            return { Hash(keyOf(properties)), maxPlayers };
+        }
+
+        /// <summary>
+        /// 入れる部屋の中で、一番人が揃っている部屋を探します。メモリの確保や文字列の比較はしません。
+        /// </summary>
+        /// <param name="key">
+        /// makeKey() で作った条件
+        /// </param>
+        /// <param name="minFreeSlots">
+        /// 最低限必要な空きの数
+        /// </param>
+        /// <returns>
+        /// 見つからない場合は nullptr
+        /// </returns>
+        [[nodiscard]] const RoomEntry* findBestRoom(const RoomKey& key, s3d::int32 minFreeSlots = 1) const {
+            const auto group = m_groups.find(key);
+
+            if (group == m_groups.end()) {
+                return nullptr;
+            }
+
+            const auto slots = group->second.lower_bound(minFreeSlots);
+
+            if (slots == group->second.end()) {
+                return nullptr;
+            }
+
+            return *slots->second.begin();
+        }
+
+        /// <summary>
+        /// 全ての部屋を順に渡します。
+        /// </summary>
+        /// <param name="function">
+        /// 部屋を受け取る関数
+        /// </param>
+        /// <returns>
+        /// なし
+        /// </returns>
+        template<class Function>
+        void forEach(Function function) const {
+            for (const auto& room : m_rooms) {
+                function(room.second);
+            }
+        }
+    };
+}  // namespace Utility
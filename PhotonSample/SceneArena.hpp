@@ -0,0 +1,214 @@
+﻿#pragma once
+#define NO_S3D_USING
+#include <Siv3D.hpp>  // OpenSiv3D v0.4.3
+#include <atomic>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+
+// 定義すると、PHOTONSAMPLE_DEFINE_ALLOCATION_COUNTER() で置き換えた operator new がプロセス全体の確保を数える
+// #define PHOTONSAMPLE_COUNT_ALLOCATIONS
+
+#ifdef PHOTONSAMPLE_COUNT_ALLOCATIONS
+/// <summary>
+/// 確保を数える operator new / delete を定義します。1つの .cpp でだけ、名前空間の外で使ってください。
+/// </summary>
+/// <remarks>
+/// アラインメントを指定した確保は置き換えないので数えません。
+/// </remarks>
+#    define PHOTONSAMPLE_DEFINE_ALLOCATION_COUNTER()                                  \
+        void* operator new(std::size_t size) {                                       \
+            ::Utility::detail::CountGlobalAllocation(size);                          \
+            if (void* p = std::malloc(size ? size : 1)) {                            \
+                return p;                                                            \
+            }                                                                        \
+            throw std::bad_alloc();                                                  \
+        }                                                                            \
+        void* operator new[](std::size_t size) {                                     \
+            return ::operator new(size);                                             \
+        }                                                                            \
+        void operator delete(void* p) noexcept {                                     \
+            std::free(p);                                                            \
+        }                                                                            \
+        void operator delete[](void* p) noexcept {                                   \
+            std::free(p);                                                            \
+        }                                                                            \
+        void operator delete(void* p, std::size_t) noexcept {                        \
+            std::free(p);                                                            \
+        }                                                                            \
+        void operator delete[](void* p, std::size_t) noexcept {                      \
+            std::free(p);                                                            \
+        }
+#else
+#    define PHOTONSAMPLE_DEFINE_ALLOCATION_COUNTER()
+#endif
+
+namespace Utility {
+    /// <summary>
+    /// メモリ確保の回数とバイト数
+    /// </summary>
+    /// <remarks>
+    /// 数えるのはアリーナを通した確保だけです。アリーナを使わない new や std::vector などの確保は含まれません。
+    /// それらも含めて数える場合は GlobalAllocationStats を使ってください。
+    /// </remarks>
+    struct AllocationStats {
+        // アリーナから確保した回数とバイト数
+        size_t allocations = 0;
+
+        size_t bytes = 0;
+
+        // アリーナが足りずにヒープから確保した回数とバイト数（アリーナ以外のヒープの確保は含まない）
+        size_t heapAllocations = 0;
+
+        size_t heapBytes = 0;
+    };
+
+    /// <summary>
+    /// プロセス全体の operator new の回数とバイト数
+    /// </summary>
+    struct GlobalAllocationStats {
+        size_t allocations = 0;
+
+        size_t bytes = 0;
+    };
+
+    namespace detail {
+        inline std::atomic<size_t> GlobalAllocations{ 0 };
+
+        inline std::atomic<size_t> GlobalAllocationBytes{ 0 };
+
+        inline void CountGlobalAllocation(size_t bytes) noexcept {
+            GlobalAllocations.fetch_add(1, std::memory_order_relaxed);
+            GlobalAllocationBytes.fetch_add(bytes, std::memory_order_relaxed);
+        }
+
+        /// <summary>
+        /// 確保の回数とバイト数を数えながら上流に確保を任せる
+        /// </summary>
+        class CountingResource : public std::pmr::memory_resource {
+        private:
+            std::pmr::memory_resource* m_upstream;
+
+            size_t m_allocations = 0;
+
+            size_t m_bytes = 0;
+
+            void* do_allocate(size_t bytes, size_t alignment) override {
+                ++m_allocations;
+                m_bytes += bytes;
+                return m_upstream->allocate(bytes, alignment);
+            }
+
+            void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+                m_upstream->deallocate(p, bytes, alignment);
+            }
+
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+                return this == &other;
+            }
+
+        public:
+            explicit CountingResource(std::pmr::memory_resource* upstream) noexcept : m_upstream(upstream) {}
+
+            [[nodiscard]] size_t allocations() const noexcept {
+                return m_allocations;
+            }
+
+            [[nodiscard]] size_t bytes() const noexcept {
+                return m_bytes;
+            }
+
+            void resetCount() noexcept {
+                m_allocations = 0;
+                m_bytes = 0;
+            }
+        };
+    }  // namespace detail
+
+    /// <summary>
+    /// プロセス全体の確保を数えているかを返します。
+    /// </summary>
+    [[nodiscard]] constexpr bool IsGlobalAllocationCounted() noexcept {
+#ifdef PHOTONSAMPLE_COUNT_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /// <summary>
+    /// 起動してからのプロセス全体の operator new の回数とバイト数を取得します。
+    /// </summary>
+    /// <returns>
+    /// PHOTONSAMPLE_COUNT_ALLOCATIONS が定義されていない場合は常に 0
+    /// </returns>
+    [[nodiscard]] inline GlobalAllocationStats GetGlobalAllocationStats() noexcept {
+        return { detail::GlobalAllocations.load(std::memory_order_relaxed), detail::GlobalAllocationBytes.load(std::memory_order_relaxed) };
+    }
+
+    /// <summary>
+    /// シーン単位のアリーナ
+    /// </summary>
+    /// <remarks>
+    /// 確保したメモリは個別には解放されず、release() かアリーナの破棄でまとめて解放されます。
+    /// 最初のバッファは初期化時に一度だけ確保するので、その範囲に収まる限り release() 後もヒープを使いません。
+    /// </remarks>
+    class SceneArena : s3d::Uncopyable {
+    private:
+        std::unique_ptr<std::byte[]> m_buffer;
+
+        detail::CountingResource m_heap;
+
+        std::pmr::monotonic_buffer_resource m_arena;
+
+        detail::CountingResource m_counter;
+
+    public:
+        /// <summary>
+        /// アリーナを初期化します。
+        /// </summary>
+        /// <param name="bufferSize">
+        /// 最初に確保しておくバッファの大きさ
+        /// </param>
+        explicit SceneArena(size_t bufferSize = 64 * 1024)
+            : m_buffer(new std::byte[bufferSize]),
+              m_heap(std::pmr::new_delete_resource()),
+              m_arena(m_buffer.get(), bufferSize, &m_heap),
+              m_counter(&m_arena) {}
+
+        /// <summary>
+        /// std::pmr のコンテナなどに渡すための memory_resource を取得します。
+        /// </summary>
+        /// <returns>
+        /// アリーナの memory_resource
+        /// </returns>
+        [[nodiscard]] std::pmr::memory_resource* resource() noexcept {
+            return &m_counter;
+        }
+
+        /// <summary>
+        /// アリーナから確保したメモリを全て解放します。
+        /// </summary>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void release() {
+            m_arena.release();
+        }
+
+        /// <summary>
+        /// 前回 resetStats() してからの確保の回数とバイト数を取得します。
+        /// </summary>
+        /// <returns>
+        /// 確保の回数とバイト数
+        /// </returns>
+        [[nodiscard]] AllocationStats stats() const noexcept {
+            return { m_counter.allocations(), m_counter.bytes(), m_heap.allocations(), m_heap.bytes() };
+        }
+
+        void resetStats() noexcept {
+            m_counter.resetCount();
+            m_heap.resetCount();
+        }
+    };
+}  // namespace Utility
@@ -3,6 +3,16 @@
 //#define NOMINMAX
 #include <Siv3D.hpp>  // OpenSiv3D v0.4.3
 #include <LoadBalancing-cpp/inc/Client.h>
+#include "RegionSelector.hpp"
+#include "SceneArena.hpp"
+#include "TrafficMonitor.hpp"
+#include "NetworkSimulator.hpp"
+#include "Lockstep.hpp"
+#include "RoomIndex.hpp"
+#include "Logger.hpp"
+#include "EventCompressor.hpp"
+#include "PropertyStore.hpp"
+#include "FrameScheduler.hpp"
 
 using s3d::int32;
 using s3d::uint32;
@@ -68,11 +78,16 @@ namespace Utility {
 
             SceneMaster<State_t, Data_t>* _m;
 
+            std::shared_ptr<SceneArena> _a;
+
             InitData() = default;
 
-            InitData(const State_t& _state, const std::shared_ptr<Data_t>& data, SceneMaster<State_t, Data_t>* manager) : state(_state), _s(data), _m(manager) {}
+            InitData(const State_t& _state, const std::shared_ptr<Data_t>& data, SceneMaster<State_t, Data_t>* manager, const std::shared_ptr<SceneArena>& arena = nullptr)
+                : state(_state), _s(data), _m(manager), _a(arena) {}
         };
 
+        using EventHandler_t = std::function<void(int, const ExitGames::Common::Object&)>;
+
     private:
         State_t m_state;
 
@@ -80,6 +95,12 @@ namespace Utility {
 
         SceneMaster<State_t, Data_t>* m_manager;
 
+        // シーンが破棄される時にまとめて解放される
+        std::shared_ptr<SceneArena> m_arena;
+
+        // イベントコードで引くハンドラの表（シーンと一緒に破棄される）
+        std::array<EventHandler_t, 256> m_eventHandlers;
+
     public:
         virtual void DebugReturn(int /*debugLevel*/, const ExitGames::Common::JString& /*string*/) {}
 
@@ -118,25 +139,93 @@ namespace Utility {
                                           int /*errorCode*/,
                                           const ExitGames::Common::JString& /*errorString*/) {}
 
-    public:
-        explicit IScene(const InitData& init) : m_state(init.state), m_data(init._s), m_manager(init._m) {}
+        virtual void JoinRoomReturn(int /*localPlayerNr*/,
+                                    const ExitGames::Common::Hashtable& /*roomProperties*/,
+                                    const ExitGames::Common::Hashtable& /*playerProperties*/,
+                                    int /*errorCode*/,
+                                    const ExitGames::Common::JString& /*errorString*/) {}
 
-        virtual void Connect() {
-            m_manager->GetClient().setAutoJoinLobby(true);
+        /// <summary>
+        /// ロビーの部屋の一覧が変わった時に呼ばれる
+        /// </summary>
+        virtual void RoomListUpdateAction() {}
 
-            if (!m_manager->GetClient().connect(ExitGames::LoadBalancing::AuthenticationValues().setUserID(ExitGames::Common::JString() + GETTIMEMS()))) {
-                return;
-            }
+        /// <summary>
+        /// 部屋のカスタムプロパティが変わった時に呼ばれる。getRoomProperties() には反映済み
+        /// </summary>
+        /// <param name="changes">変更されたキーと値</param>
+        virtual void RoomPropertiesChangeAction(const ExitGames::Common::Hashtable& /*changes*/) {}
+
+        /// <summary>
+        /// プレイヤーのカスタムプロパティが変わった時に呼ばれる。getPlayerProperties() には反映済み
+        /// </summary>
+        /// <param name="playerNr">プレイヤー番号</param>
+        /// <param name="changes">変更されたキーと値</param>
+        virtual void PlayerPropertiesChangeAction(int /*playerNr*/, const ExitGames::Common::Hashtable& /*changes*/) {}
+
+        /// <summary>
+        /// 予期しない切断を検知し、再接続を予約した時に呼ばれる
+        /// </summary>
+        /// <param name="attempt">何回目の再接続か(1から始まる)</param>
+        /// <param name="delayMillisec">再接続を試みるまでの待ち時間（ミリ秒）</param>
+        virtual void ReconnectingAction(s3d::int32 /*attempt*/, s3d::int32 /*delayMillisec*/) {}
+
+        /// <summary>
+        /// 再接続と部屋への再入室が終わった時に呼ばれる
+        /// </summary>
+        /// <param name="errorCode">成功した場合は 0</param>
+        /// <param name="recoveryTime">切断を検知してから復帰(または断念)するまでの時間</param>
+        virtual void ReconnectReturn(int /*errorCode*/, const s3d::Duration& /*recoveryTime*/) {}
+
+    public:
+        explicit IScene(const InitData& init)
+            : m_state(init.state), m_data(init._s), m_manager(init._m), m_arena(init._a ? init._a : std::make_shared<SceneArena>()) {}
 
-            m_manager->UsePhoton(true);
+        virtual void Connect() {
+            m_manager->Connect();
         }
 
         virtual void Disconnect() {
-            m_manager->GetClient().disconnect();
+            m_manager->Disconnect();
+        }
+
+        /// <summary>
+        /// 後のシーンで Connect() する時のために、先に接続しておきます。
+        /// </summary>
+        /// <param name="joinLobby">
+        /// ロビーまで入っておくか
+        /// </param>
+        /// <param name="idleTimeout">
+        /// 使われなかった接続を切断するまでの時間
+        /// </param>
+        virtual void PreConnect(bool joinLobby = true, const s3d::Duration& idleTimeout = s3d::SecondsF(30)) {
+            m_manager->PreConnect(joinLobby, idleTimeout);
         }
 
         virtual ~IScene() {}
 
+        /// <summary>
+        /// 受信したイベントを登録済みのハンドラに渡します。
+        /// </summary>
+        /// <returns>
+        /// ハンドラが登録されていた場合 true, それ以外の場合は false
+        /// </returns>
+        bool DispatchEvent(int playerNr, nByte eventCode, const ExitGames::Common::Object& eventContent) {
+            const EventHandler_t& handler = m_eventHandlers[eventCode];
+
+            if (!handler) {
+                return false;
+            }
+
+            handler(playerNr, eventContent);
+
+            return true;
+        }
+
+        [[nodiscard]] const std::shared_ptr<SceneArena>& getSceneArena() const noexcept {
+            return m_arena;
+        }
+
         virtual void UpdatePhoton() {}
 
         virtual void RunPhoton() {
@@ -145,7 +234,43 @@ namespace Utility {
         }
 
         virtual void CreateRoom(const ExitGames::Common::JString& roomName_, const ExitGames::Common::Hashtable& properties_, const nByte maxPlayers_) {
-            m_manager->GetClient().opCreateRoom(roomName_, ExitGames::LoadBalancing::RoomOptions().setMaxPlayers(maxPlayers_).setCustomRoomProperties(properties_));
+            // ランダム入室の条件や部屋の一覧の索引に使えるよう、プロパティをロビーに公開する
+            ExitGames::Common::JVector<ExitGames::Common::JString> propsListedInLobby;
+
+            const ExitGames::Common::JVector<ExitGames::Common::Object>& keys = properties_.getKeys();
+
+            for (unsigned int i = 0; i < keys.getSize(); ++i) {
+                propsListedInLobby.addElement(ExitGames::Common::ValueObject<ExitGames::Common::JString>(keys[i]).getDataCopy());
+            }
+
+            // 切断したプレイヤーが再入室できるよう、部屋とプレイヤーの情報をしばらく残しておく
+            m_manager->CreateRoom(roomName_, ExitGames::LoadBalancing::RoomOptions()
+                                                 .setMaxPlayers(maxPlayers_)
+                                                 .setCustomRoomProperties(properties_)
+                                                 .setPropsListedInLobby(propsListedInLobby)
+                                                 .setPlayerTtl(m_manager->getPlayerTtl())
+                                                 .setEmptyRoomTtl(m_manager->getPlayerTtl()));
+        }
+
+        virtual void JoinRandomRoom(const ExitGames::Common::Hashtable& properties_, const nByte maxPlayers_) {
+            m_manager->JoinRandomRoom(properties_, maxPlayers_);
+        }
+
+        virtual void JoinRoom(const ExitGames::Common::JString& roomName_) {
+            m_manager->JoinRoom(roomName_);
+        }
+
+        template<class Ftype>
+        void RaiseEvent(bool reliable_, const Ftype& parameters_, nByte eventCode_, const ExitGames::LoadBalancing::RaiseEventOptions& options_ = ExitGames::LoadBalancing::RaiseEventOptions()) {
+            m_manager->RaiseEvent(reliable_, parameters_, eventCode_, options_);
+        }
+
+        bool StartLockstep(const LockstepSettings& settings_ = LockstepSettings()) {
+            return m_manager->StartLockstep(settings_);
+        }
+
+        void StopLockstep() {
+            m_manager->StopLockstep();
         }
 
         ExitGames::LoadBalancing::Client& GetClient() {
@@ -233,6 +358,146 @@ namespace Utility {
             return *m_data;
         }
 
+        /// <summary>
+        /// シーン用のアリーナを取得します。
+        /// </summary>
+        /// <remarks>
+        /// ここから確保したメモリはシーンが破棄される時にまとめて解放されます。
+        /// </remarks>
+        /// <returns>
+        /// std::pmr のコンテナなどに渡す memory_resource
+        /// </returns>
+        [[nodiscard]] std::pmr::memory_resource* getArena() const {
+            return m_arena->resource();
+        }
+
+        /// <summary>
+        /// 1フレームだけ使う一時的なアリーナを取得します。
+        /// </summary>
+        /// <remarks>
+        /// ここから確保したメモリは次の SceneMaster::update() で解放されます。
+        /// </remarks>
+        /// <returns>
+        /// std::pmr のコンテナなどに渡す memory_resource
+        /// </returns>
+        [[nodiscard]] std::pmr::memory_resource* getFrameArena() const {
+            return m_manager->getFrameArena();
+        }
+
+        /// <summary>
+        /// イベントコードに対応するハンドラを登録します。
+        /// </summary>
+        /// <remarks>
+        /// ハンドラが登録されたイベントコードのイベントは CustomEventAction に渡されません。
+        /// </remarks>
+        /// <param name="eventCode">
+        /// イベントコード
+        /// </param>
+        /// <param name="handler">
+        /// void(int playerNr, const ExitGames::Common::Object& eventContent) の形のハンドラ
+        /// </param>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void registerEventHandler(nByte eventCode, EventHandler_t handler) {
+            m_eventHandlers[eventCode] = std::move(handler);
+        }
+
+        /// <summary>
+        /// イベントコードに対応するハンドラを登録します。受信した内容は Type に変換して渡されます。
+        /// </summary>
+        /// <remarks>
+        /// Type には配列以外の型を指定してください。配列は型を指定しない方で受け取ってください。
+        /// 受信した内容の型が Type と違う場合は、ハンドラではなく CustomEventAction に渡されます。
+        /// </remarks>
+        /// <param name="eventCode">
+        /// イベントコード
+        /// </param>
+        /// <param name="handler">
+        /// void(int playerNr, const Type& eventContent) の形のハンドラ
+        /// </param>
+        /// <returns>
+        /// なし
+        /// </returns>
+        template<class Type, class Handler>
+        void registerEventHandler(nByte eventCode, Handler handler) {
+            // 配列の getDataCopy() は確保したメモリを返すので、ここでは扱わない
+            static_assert(!std::is_pointer_v<Type>, "Use the untyped registerEventHandler() for array event contents");
+
+            using Allowed = ExitGames::Common::Helpers::ConfirmAllowed<Type>;
+
+            m_eventHandlers[eventCode] = [this, eventCode, handler = std::move(handler)](int playerNr, const ExitGames::Common::Object& eventContent) {
+                const bool matches = eventContent.getType() == Allowed::typeName
+                    && eventContent.getDimensions() == 0
+                    && (Allowed::typeName != ExitGames::Common::TypeCode::CUSTOM || eventContent.getCustomType() == Allowed::customTypeName);
+
+                if (!matches) {
+                    CustomEventAction(playerNr, eventCode, eventContent);
+                    return;
+                }
+
+                handler(playerNr, ExitGames::Common::ValueObject<Type>(eventContent).getDataCopy());
+            };
+        }
+
+        /// <summary>
+        /// イベントコードに対応するハンドラの登録を解除します。
+        /// </summary>
+        /// <param name="eventCode">
+        /// イベントコード
+        /// </param>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void unregisterEventHandler(nByte eventCode) {
+            m_eventHandlers[eventCode] = nullptr;
+        }
+
+        /// <summary>
+        /// 最後に Connect() してから接続が完了するまでの時間を取得します。
+        /// </summary>
+        /// <returns>
+        /// 接続にかかった時間
+        /// </returns>
+        [[nodiscard]] const s3d::Duration& getConnectTime() const {
+            return m_manager->getConnectTime();
+        }
+
+        /// <summary>
+        /// StartLockstep() で開始したロックステップを取得します。
+        /// </summary>
+        /// <returns>
+        /// 開始していない場合は nullptr
+        /// </returns>
+        [[nodiscard]] LockstepEngine* getLockstep() const {
+            return m_manager->getLockstep();
+        }
+
+        /// <summary>
+        /// ロビーの部屋の一覧の索引を取得します。
+        /// </summary>
+        [[nodiscard]] const RoomIndex& getRoomIndex() const {
+            return m_manager->getRoomIndex();
+        }
+
+        /// <summary>
+        /// 部屋のカスタムプロパティを取得します。変更は SceneMaster::update() の最後にまとめて送られます。
+        /// </summary>
+        [[nodiscard]] PropertyStore& getRoomProperties() {
+            return m_manager->getRoomProperties();
+        }
+
+        /// <summary>
+        /// プレイヤーのカスタムプロパティを取得します。変更は SceneMaster::update() の最後にまとめて送られます。
+        /// </summary>
+        [[nodiscard]] PropertyStore& getPlayerProperties(int playerNr) {
+            return m_manager->getPlayerProperties(playerNr);
+        }
+
+        [[nodiscard]] PropertyStore& getLocalPlayerProperties() {
+            return m_manager->getPlayerProperties(GetClient().getLocalPlayer().getNumber());
+        }
+
         /// <summary>
         /// シーンの変更を通知します。
         /// </summary>
@@ -342,132 +607,1107 @@ namespace Utility {
 
         ExitGames::LoadBalancing::Client m_loadBalancingClient;
 
-        bool updateSingle() {
-            double elapsed = m_stopwatch.msF();
+        // 毎フレーム解放する一時的なアリーナ
+        SceneArena m_frameArena;
 
-            if (m_transitionState == TransitionState::FadeOut && elapsed >= m_transitionTimeMillisec) {
-                m_current = nullptr;
+        AllocationStats m_sceneAllocationStats;
 
-                m_current = m_factories[m_nextState]();
+        AllocationStats m_frameAllocationStats;
 
-                if (hasError()) {
-                    return false;
-                }
+        // PHOTONSAMPLE_COUNT_ALLOCATIONS を定義した場合の、前のフレームのプロセス全体の確保
+        GlobalAllocationStats m_globalAllocationStats;
 
-                m_currentState = m_nextState;
+        GlobalAllocationStats m_globalAllocationTotal;
 
-                m_transitionState = TransitionState::FadeIn;
+        // 無効の場合は nullptr
+        std::unique_ptr<TrafficMonitor> m_trafficMonitor;
 
-                m_stopwatch.restart();
+        // 悪い通信環境の再現
+        NetworkSimulator m_networkSimulator;
 
-                elapsed = 0.0;
+        // ロックステップ中でない場合は nullptr
+        std::unique_ptr<LockstepEngine> m_lockstep;
+
+        s3d::Stopwatch m_lockstepClock{ true };
+
+        // ロビーの部屋の一覧
+        RoomIndex m_roomIndex;
+
+        EventCompressor m_eventCompressor;
+
+        // 今いる部屋とプレイヤーのカスタムプロパティ
+        PropertyStore m_roomProperties;
+
+        std::map<int, PropertyStore> m_playerProperties;
+
+        // 描画・更新・通信の頻度
+        FrameScheduler m_frameScheduler;
+
+        enum class ReconnectState {
+            None,
+
+            Waiting,  // 次の再接続まで待機中
+
+            Connecting,  // reconnectAndRejoin() が使えず、接続からやり直している
+
+            Rejoining,  // 部屋への再入室中
+
+        } m_reconnectState
+            = ReconnectState::None;
+
+        // 自分から切断した場合は再接続しない
+        bool m_disconnectRequested = false;
+
+        // 再接続時に使うユーザーIDと部屋の名前
+        ExitGames::Common::JString m_userID;
+
+        ExitGames::Common::JString m_roomName;
+
+        s3d::int32 m_reconnectAttempt = 0;
+
+        s3d::int32 m_reconnectDelayMillisec = 0;
+
+        s3d::int32 m_maxReconnectAttempts = 6;
+
+        s3d::int32 m_reconnectBaseDelayMillisec = 250;
+
+        s3d::int32 m_reconnectMaxDelayMillisec = 8000;
+
+        s3d::int32 m_playerTtlMillisec = 30000;
+
+        s3d::Stopwatch m_reconnectStopwatch;
+
+        s3d::Stopwatch m_recoveryStopwatch;
+
+        // 地域の選択（RegionSelectionMode::SELECT の時のみ使う）
+        std::unique_ptr<RegionSelector> m_regionSelector;
+
+        bool m_regionSelected = false;
+
+        s3d::Array<ExitGames::Common::JString> m_availableRegions;
+
+        // connect() から connectReturn までの時間
+        s3d::Stopwatch m_connectStopwatch;
+
+        s3d::Duration m_connectTime = s3d::Duration(0);
+
+        // シーン遷移中などに、先に接続だけ済ませておく
+        enum class PreConnectState {
+            None,
+
+            Connecting,
+
+            Ready,  // 接続済みで、シーンが Connect() するのを待っている
+
+            Closing,  // 使われなかったので切断中
+
+        } m_preConnectState
+            = PreConnectState::None;
+
+        s3d::int32 m_preConnectIdleTimeoutMillisec = 0;
+
+        s3d::Stopwatch m_preConnectStopwatch;
+
+        // 切断中に Connect() された場合は、切断後に接続し直す
+        bool m_connectAfterClose = false;
+
+        // 接続済みの接続を引き継いだシーンに connectReturn を届ける
+        bool m_deliverConnectReturn = false;
+
+        ExitGames::Common::JString m_connectedRegion;
+
+        ExitGames::Common::JString m_connectedCluster;
+
+        // 中身の無いコールバックや操作の大きさとして扱うバイト数
+        static constexpr size_t ControlMessageBytes = 64;
+
+        /// <summary>
+        /// 送受信するデータの大きさを求めます。帯域制限が無い場合はシリアライズせずに 0 を返します。
+        /// </summary>
+        template<class Type>
+        [[nodiscard]] size_t payloadSize(const Type& payload) const {
+            if (!m_networkSimulator.isBandwidthLimited()) {
+                return 0;
             }
 
-            if (m_transitionState == TransitionState::FadeIn && elapsed >= m_transitionTimeMillisec) {
-                m_stopwatch.reset();
+            ExitGames::Common::Serializer serializer;
 
-                m_transitionState = TransitionState::Active;
+            serializer.push(payload);
+
+            return ControlMessageBytes + serializer.getSize();
+        }
+
+        /// <summary>
+        /// 受信したコールバックをシーンに届けます。通信環境を再現している場合は、再現した到着時刻まで遅らせます。
+        /// </summary>
+        /// <remarks>
+        /// 遅らせる場合のみ引数をコピーします。
+        /// </remarks>
+        template<class Function, class... Args>
+        void receive(size_t bytes, bool reliable, Function function, const Args&... args) {
+            if (!m_networkSimulator.isEnabled()) {
+                function(args...);
+                return;
             }
 
-            switch (m_transitionState) {
-            case TransitionState::FadeIn:
-                assert(m_transitionTimeMillisec);
-                m_current->updateFadeIn(elapsed / m_transitionTimeMillisec);
-                return !hasError();
-            case TransitionState::Active:
-                m_current->update();
-                if (UsePhoton()) {
-                    m_current->RunPhoton();
+            m_networkSimulator.schedule(NetworkSimulator::Direction::Incoming, bytes, reliable, [function, arguments = std::make_tuple(args...)]() {
+                std::apply(function, arguments);
+            });
+        }
+
+        /// <summary>
+        /// 操作をサーバーに送ります。通信環境を再現している場合は、再現した到着時刻まで遅らせます。
+        /// </summary>
+        template<class Function, class... Args>
+        void send(size_t bytes, bool reliable, Function function, const Args&... args) {
+            if (!m_networkSimulator.isEnabled()) {
+                function(args...);
+                return;
+            }
+
+            m_networkSimulator.schedule(NetworkSimulator::Direction::Outgoing, bytes, reliable, [function, arguments = std::make_tuple(args...)]() {
+                std::apply(function, arguments);
+            });
+        }
+
+        template<class Ftype>
+        void sendEvent(bool reliable, const Ftype& parameters, nByte eventCode, const ExitGames::LoadBalancing::RaiseEventOptions& options) {
+            send(payloadSize(parameters), reliable, [this, reliable](const Ftype& parameters_, nByte eventCode_, const ExitGames::LoadBalancing::RaiseEventOptions& options_) {
+                m_loadBalancingClient.opRaiseEvent(reliable, parameters_, eventCode_, options_);
+            }, parameters, eventCode, options);
+        }
+
+        /// <summary>
+        /// 受信したカスタムイベントを、ロックステップ・登録したハンドラ・シーンの順に届けます。
+        /// </summary>
+        void dispatchCustomEvent(int playerNr, nByte eventCode, const ExitGames::Common::Object& eventContent) {
+            // 圧縮を使っていない場合、このイベントコードはアプリのイベントとして届ける
+            if (eventCode == EventCompressor::EventCode && m_eventCompressor.isEnabled()) {
+                nByte originalCode;
+
+                ExitGames::Common::Object originalContent;
+
+                if (!m_eventCompressor.decompress(eventContent, originalCode, originalContent)) {
+                    PHOTONSAMPLE_LOG(LogLevel::Warning, U"failed to decompress event", LogField(U"playerNr", playerNr));
+                    return;
                 }
-                return !hasError();
-            case TransitionState::FadeOut:
-                assert(m_transitionTimeMillisec);
-                m_current->updateFadeOut(elapsed / m_transitionTimeMillisec);
-                return !hasError();
-            default:
-                return false;
+
+                dispatchCustomEvent(playerNr, originalCode, originalContent);
+                return;
+            }
+
+            if (m_lockstep && eventCode == m_lockstep->getSettings().eventCode) {
+                if (playerNr == m_lockstep->getRemotePlayerNr()) {
+                    m_lockstep->receivePacket(eventContent, m_lockstepClock.msF());
+                }
+
+                return;
+            }
+
+            if (m_current->DispatchEvent(playerNr, eventCode, eventContent)) {
+                return;
+            }
+
+            m_current->CustomEventAction(playerNr, eventCode, eventContent);
+        }
+
+        /// <summary>
+        /// 入室した部屋と部屋にいるプレイヤーのカスタムプロパティを読み込みます。
+        /// </summary>
+        void loadProperties() {
+            const ExitGames::LoadBalancing::MutableRoom& room = m_loadBalancingClient.getCurrentlyJoinedRoom();
+
+            m_roomProperties.reset(room.getCustomProperties());
+
+            const auto& players = room.getPlayers();
+
+            for (unsigned int i = 0; i < players.getSize(); ++i) {
+                m_playerProperties[players[i]->getNumber()].reset(players[i]->getCustomProperties());
             }
         }
 
-        bool updateCross() {
-            const double elapsed = m_stopwatch.msF();
+        void clearProperties() {
+            m_roomProperties.clear();
+
+            m_playerProperties.clear();
+        }
+
+        /// <summary>
+        /// このフレームに変更されたカスタムプロパティを、部屋とプレイヤーごとに1回の操作で送ります。
+        /// </summary>
+        void flushProperties() {
+            if (!m_loadBalancingClient.getIsInGameRoom()) {
+                return;
+            }
+
+            if (m_roomProperties.isDirty()) {
+                m_roomProperties.flush([this](const ExitGames::Common::Hashtable& properties, const ExitGames::Common::Hashtable& expected) {
+                    send(payloadSize(properties), true, [this](const ExitGames::Common::Hashtable& properties_, const ExitGames::Common::Hashtable& expected_) {
+                        m_loadBalancingClient.opSetPropertiesOfRoom(properties_, expected_);
+                    }, properties, expected);
+                });
+            }
+
+            for (auto& [playerNr, store] : m_playerProperties) {
+                if (!store.isDirty()) {
+                    continue;
+                }
+
+                store.flush([this, playerNr = playerNr](const ExitGames::Common::Hashtable& properties, const ExitGames::Common::Hashtable& expected) {
+                    send(payloadSize(properties), true, [this](int playerNr_, const ExitGames::Common::Hashtable& properties_, const ExitGames::Common::Hashtable& expected_) {
+                        m_loadBalancingClient.opSetPropertiesOfPlayer(playerNr_, properties_, expected_);
+                    }, playerNr, properties, expected);
+                });
+            }
+        }
+
+        /// <summary>
+        /// ロックステップの溜まった入力を送ります。
+        /// </summary>
+        void sendLockstepInputs() {
+            if (!m_lockstep) {
+                return;
+            }
+
+            if (auto packet = m_lockstep->makePacket(m_lockstepClock.msF())) {
+                ExitGames::LoadBalancing::RaiseEventOptions options;
+
+                const int targetPlayers[] = { m_lockstep->getRemotePlayerNr() };
+
+                options.setTargetPlayers(targetPlayers, 1);
+
+                // 毎ティック送る小さいパケットなので、圧縮を試さずに送る
+                sendEvent(false, *packet, m_lockstep->getSettings().eventCode, options);
+            }
+        }
+
+        /// <summary>
+        /// 前のフレームの確保の回数を記録し、一時的なアリーナを解放します。
+        /// </summary>
+        void beginFrameArena() {
+            if (m_current) {
+                m_sceneAllocationStats = m_current->getSceneArena()->stats();
+
+                m_current->getSceneArena()->resetStats();
+            }
+
+            m_frameAllocationStats = m_frameArena.stats();
+
+            m_frameArena.resetStats();
+
+            m_frameArena.release();
+
+            const GlobalAllocationStats total = GetGlobalAllocationStats();
+
+            m_globalAllocationStats = { total.allocations - m_globalAllocationTotal.allocations, total.bytes - m_globalAllocationTotal.bytes };
+
+            m_globalAllocationTotal = total;
+        }
+
+        /// <summary>
+        /// 計測が終わっていれば、まだ地域を選んでいない場合に最も速い地域を選びます。
+        /// </summary>
+        void updateRegionSelector() {
+            if (!m_regionSelector || !m_regionSelector->update() || m_regionSelected) {
+                return;
+            }
+
+            const auto& best = m_regionSelector->getBest();
+
+            selectRegion(best ? ConvertStringToJString(best->region) : m_availableRegions.front());
+        }
+
+        void selectRegion(const ExitGames::Common::JString& region) {
+            m_regionSelected = true;
+
+            m_loadBalancingClient.selectRegion(region);
+        }
+
+        /// <summary>
+        /// 先に接続しておいた接続を、一定時間使われなければ切断します。
+        /// 引き継がれた接続については、シーンに connectReturn を届けます。
+        /// </summary>
+        void updatePreConnect() {
+            if (m_deliverConnectReturn && m_transitionState != TransitionState::FadeInOut) {
+                m_deliverConnectReturn = false;
+
+                m_connectTime = m_connectStopwatch.elapsed();
+
+                receive(ControlMessageBytes, true, [this](const ExitGames::Common::JString& region_, const ExitGames::Common::JString& cluster_) {
+                    m_current->ConnectReturn(ExitGames::LoadBalancing::ErrorCode::OK, L"", region_, cluster_);
+                }, m_connectedRegion, m_connectedCluster);
+            }
+
+            if (m_preConnectState == PreConnectState::Ready && m_preConnectStopwatch.ms() >= m_preConnectIdleTimeoutMillisec) {
+                m_preConnectState = PreConnectState::Closing;
+
+                m_loadBalancingClient.disconnect();
+            }
+        }
+
+        /// <summary>
+        /// シーンの遷移中も接続が切れないよう通信を行います。
+        /// </summary>
+        void serviceDuringTransition() {
+            if (UsePhoton() && m_frameScheduler.isNetworkDue()) {
+                m_loadBalancingClient.service();
+
+                m_frameScheduler.countService();
+            }
+        }
+
+        /// <summary>
+        /// 通常時のシーンの更新と通信を、それぞれの頻度で行います。
+        /// </summary>
+        void updateActive() {
+            if (m_frameScheduler.isUpdateDue()) {
+                m_current->update();
+            }
+
+            if (UsePhoton() && m_frameScheduler.isNetworkDue()) {
+                m_current->RunPhoton();
+
+                m_frameScheduler.countService();
+            }
+        }
+
+        [[nodiscard]] bool isReconnecting() const noexcept {
+            return m_reconnectState != ReconnectState::None;
+        }
+
+        /// <summary>
+        /// 次の再接続を予約します。試行回数を超えた場合は諦めてシーンに切断を通知します。
+        /// </summary>
+        void scheduleReconnect() {
+            if (m_reconnectAttempt >= m_maxReconnectAttempts) {
+                m_reconnectState = ReconnectState::None;
+
+                m_roomName = L"";
+
+                clearProperties();
+
+                // 他のコールバックを追い越さないよう、disconnectReturn() と同じ経路で通知する
+                receive(ControlMessageBytes, true, [this, recoveryTime = m_recoveryStopwatch.elapsed()]() {
+                    m_current->ReconnectReturn(ExitGames::LoadBalancing::ErrorCode::OPERATION_INVALID, recoveryTime);
+
+                    m_current->DisconnectReturn();
+                });
+
+                return;
+            }
+
+            // 指数バックオフ（同時に切れた他のクライアントと重ならないよう少しずらす）
+            const s3d::int32 delay = s3d::Min(m_reconnectBaseDelayMillisec << s3d::Min(m_reconnectAttempt, 16), m_reconnectMaxDelayMillisec);
+
+            m_reconnectDelayMillisec = delay + s3d::Random(0, delay / 4);
+
+            m_reconnectState = ReconnectState::Waiting;
+
+            m_reconnectStopwatch.restart();
+
+            m_current->ReconnectingAction(m_reconnectAttempt + 1, m_reconnectDelayMillisec);
+        }
+
+        /// <summary>
+        /// 待ち時間が過ぎていれば再接続を試みます。
+        /// </summary>
+        void updateReconnect() {
+            if (m_reconnectState != ReconnectState::Waiting || m_reconnectStopwatch.ms() < m_reconnectDelayMillisec) {
+                return;
+            }
+
+            ++m_reconnectAttempt;
+
+            // セッションのトークンが残っていればゲームサーバーに直接戻る
+            if (m_loadBalancingClient.reconnectAndRejoin()) {
+                m_reconnectState = ReconnectState::Rejoining;
+            }
+            else if (m_loadBalancingClient.connect(ExitGames::LoadBalancing::AuthenticationValues().setUserID(m_userID))) {
+                m_reconnectState = ReconnectState::Connecting;
+            }
+            else {
+                scheduleReconnect();
+                return;
+            }
+
+            m_usePhoton = true;
+        }
+
+        /// <summary>
+        /// 再接続を終了し、シーンに結果を通知します。
+        /// </summary>
+        void finishReconnect(int errorCode) {
+            m_reconnectState = ReconnectState::None;
+
+            m_reconnectAttempt = 0;
+
+            receive(ControlMessageBytes, true, [this](int errorCode_, const s3d::Duration& recoveryTime_) {
+                m_current->ReconnectReturn(errorCode_, recoveryTime_);
+            }, errorCode, m_recoveryStopwatch.elapsed());
+
+            m_recoveryStopwatch.reset();
+        }
+
+        bool updateSingle() {
+            double elapsed = m_stopwatch.msF();
+
+            if (m_transitionState == TransitionState::FadeOut && elapsed >= m_transitionTimeMillisec) {
+                m_current = nullptr;
+
+                m_current = m_factories[m_nextState]();
+
+                if (hasError()) {
+                    return false;
+                }
+
+                m_currentState = m_nextState;
+
+                m_transitionState = TransitionState::FadeIn;
+
+                m_stopwatch.restart();
+
+                elapsed = 0.0;
+            }
+
+            if (m_transitionState == TransitionState::FadeIn && elapsed >= m_transitionTimeMillisec) {
+                m_stopwatch.reset();
+
+                m_transitionState = TransitionState::Active;
+            }
+
+            switch (m_transitionState) {
+            case TransitionState::FadeIn:
+                assert(m_transitionTimeMillisec);
+                m_current->updateFadeIn(elapsed / m_transitionTimeMillisec);
+                serviceDuringTransition();
+                return !hasError();
+            case TransitionState::Active:
+                updateActive();
+                return !hasError();
+            case TransitionState::FadeOut:
+                assert(m_transitionTimeMillisec);
+                m_current->updateFadeOut(elapsed / m_transitionTimeMillisec);
+                serviceDuringTransition();
+                return !hasError();
+            default:
+                return false;
+            }
+        }
+
+        bool updateCross() {
+            const double elapsed = m_stopwatch.msF();
+
+            if (m_transitionState == TransitionState::FadeInOut) {
+                if (elapsed >= m_transitionTimeMillisec) {
+                    m_current = m_next;
+
+                    m_next = nullptr;
+
+                    m_stopwatch.reset();
+
+                    m_transitionState = TransitionState::Active;
+                }
+            }
+
+            if (m_transitionState == TransitionState::Active) {
+                updateActive();
+
+                return !hasError();
+            }
+            else {
+                assert(m_transitionTimeMillisec);
+
+                const double t = elapsed / m_transitionTimeMillisec;
+
+                m_current->updateFadeOut(t);
+
+                if (hasError()) {
+                    return false;
+                }
+
+                m_next->updateFadeIn(t);
+
+                serviceDuringTransition();
+
+                return !hasError();
+            }
+        }
+
+        [[nodiscard]] bool hasError() const noexcept {
+            return m_error;
+        }
+
+    public:
+        /// <summary>
+        /// シーンのインタフェース
+        /// </summary>
+        using Scene = IScene<State, Data>;
+
+        /// <summary>
+        /// シーン管理を初期化します。
+        /// </summary>
+        /// <param name="regionSelectionMode">
+        /// 接続する地域の選び方。RegionSelectionMode::SELECT の場合は setRegionCache() で設定した方法で選びます。
+        /// </param>
+        SceneMaster(const ExitGames::Common::JString& appID_, const ExitGames::Common::JString& appVersion_,
+                    const nByte regionSelectionMode = ExitGames::LoadBalancing::RegionSelectionMode::DEFAULT)
+        : m_data(s3d::MakeShared<Data>()),
+          m_loadBalancingClient(*this, appID_, appVersion_, ExitGames::Photon::ConnectionProtocol::DEFAULT, false, regionSelectionMode),
+          m_usePhoton(false) {}
+
+        /// <summary>
+        /// シーン管理を初期化します。
+        /// </summary>
+        /// <param name="data">
+        /// 共有データ
+        /// </param>
+        /// <param name="regionSelectionMode">
+        /// 接続する地域の選び方。RegionSelectionMode::SELECT の場合は setRegionCache() で設定した方法で選びます。
+        /// </param>
+        explicit SceneMaster(const std::shared_ptr<Data>& data, const ExitGames::Common::JString& appID_, const ExitGames::Common::JString& appVersion_,
+                             const nByte regionSelectionMode = ExitGames::LoadBalancing::RegionSelectionMode::DEFAULT)
+        : m_data(data),
+          m_loadBalancingClient(*this, appID_, appVersion_, ExitGames::Photon::ConnectionProtocol::DEFAULT, false, regionSelectionMode),
+          m_usePhoton(false) {}
+
+        ~SceneMaster() {
+            if (UsePhoton()) {
+                m_loadBalancingClient.disconnect();
+            }
+        }
+
+        bool UsePhoton() {
+            return m_usePhoton;
+        }
+        void UsePhoton(const bool use_) {
+            m_usePhoton = use_;
+        }
+
+        /// <summary>
+        /// Photonに接続します。
+        /// </summary>
+        /// <returns>
+        /// 接続を開始できた場合 true, それ以外の場合は false
+        /// </returns>
+        bool Connect() {
+            m_disconnectRequested = false;
+
+            switch (m_preConnectState) {
+            case PreConnectState::Connecting:
+                // 接続の完了は通常どおり connectReturn で届く
+                m_preConnectState = PreConnectState::None;
+                m_connectStopwatch.restart();
+                return true;
+            case PreConnectState::Ready:
+                m_preConnectState = PreConnectState::None;
+                m_deliverConnectReturn = true;
+                m_connectStopwatch.restart();
+                return true;
+            case PreConnectState::Closing:
+                m_connectAfterClose = true;
+                return true;
+            default:
+                break;
+            }
+
+            m_loadBalancingClient.setAutoJoinLobby(true);
+
+            m_userID = ExitGames::Common::JString() + GETTIMEMS();
+
+            m_connectStopwatch.restart();
+
+            if (!m_loadBalancingClient.connect(ExitGames::LoadBalancing::AuthenticationValues().setUserID(m_userID))) {
+                return false;
+            }
+
+            m_usePhoton = true;
+
+            return true;
+        }
+
+        /// <summary>
+        /// シーンが Connect() する前に、先に接続を済ませておきます。
+        /// </summary>
+        /// <remarks>
+        /// 接続後に Connect() したシーンは、接続の完了を待たずに ConnectReturn を受け取ります。
+        /// idleTimeout の間 Connect() されなかった場合は切断します。
+        /// </remarks>
+        /// <param name="joinLobby">
+        /// ロビーまで入っておくか
+        /// </param>
+        /// <param name="idleTimeout">
+        /// 使われなかった接続を切断するまでの時間
+        /// </param>
+        /// <returns>
+        /// 接続を開始できた場合 true, 既に接続している場合などは false
+        /// </returns>
+        bool PreConnect(bool joinLobby = true, const s3d::Duration& idleTimeout = s3d::SecondsF(30)) {
+            if (UsePhoton() || isReconnecting() || m_preConnectState != PreConnectState::None) {
+                return false;
+            }
+
+            m_loadBalancingClient.setAutoJoinLobby(joinLobby);
+
+            m_userID = ExitGames::Common::JString() + GETTIMEMS();
+
+            if (!m_loadBalancingClient.connect(ExitGames::LoadBalancing::AuthenticationValues().setUserID(m_userID))) {
+                return false;
+            }
+
+            m_preConnectIdleTimeoutMillisec = static_cast<s3d::int32>(idleTimeout.count() * 1000);
+
+            m_preConnectState = PreConnectState::Connecting;
+
+            m_usePhoton = true;
+
+            return true;
+        }
+
+        /// <summary>
+        /// Photonから切断します。自分から切断した場合は再接続を行いません。
+        /// </summary>
+        /// <remarks>
+        /// 部屋にいる場合は退室してから切断するので、他のプレイヤーには非アクティブではなく退室として届きます。
+        /// </remarks>
+        void Disconnect() {
+            m_disconnectRequested = true;
+
+            m_deliverConnectReturn = false;
+
+            if (m_reconnectState == ReconnectState::Waiting) {
+                // 接続していないので disconnectReturn は呼ばれない
+                m_reconnectState = ReconnectState::None;
+
+                m_roomName = L"";
+
+                clearProperties();
+
+                receive(ControlMessageBytes, true, [this]() {
+                    m_current->DisconnectReturn();
+                });
+
+                return;
+            }
+
+            m_reconnectState = ReconnectState::None;
+
+            // 部屋の中で自分から切断する場合は、非アクティブのまま残らないように先に退室する
+            if (m_loadBalancingClient.getIsInGameRoom()) {
+                m_loadBalancingClient.opLeaveRoom(false);
+
+                m_loadBalancingClient.sendOutgoingCommands();
+            }
+
+            m_loadBalancingClient.disconnect();
+        }
+
+        /// <summary>
+        /// 予期しない切断が起きた時の再接続の方針を設定します。
+        /// </summary>
+        /// <param name="maxAttempts">
+        /// 再接続を試みる最大回数（0 の場合は再接続しない）
+        /// </param>
+        /// <param name="baseDelayMillisec">
+        /// 最初の再接続までの待ち時間（ミリ秒）。以降は試行ごとに倍になります。
+        /// </param>
+        /// <param name="maxDelayMillisec">
+        /// 待ち時間の上限（ミリ秒）
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        SceneMaster& setReconnectPolicy(s3d::int32 maxAttempts, s3d::int32 baseDelayMillisec, s3d::int32 maxDelayMillisec) {
+            m_maxReconnectAttempts = maxAttempts;
+            m_reconnectBaseDelayMillisec = baseDelayMillisec;
+            m_reconnectMaxDelayMillisec = maxDelayMillisec;
+            return *this;
+        }
+
+        /// <summary>
+        /// 切断したプレイヤーが部屋に再入室できる時間を設定します。
+        /// </summary>
+        /// <param name="playerTtlMillisec">
+        /// 再入室できる時間（ミリ秒）
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        SceneMaster& setPlayerTtl(s3d::int32 playerTtlMillisec) {
+            m_playerTtlMillisec = playerTtlMillisec;
+            return *this;
+        }
+
+        [[nodiscard]] s3d::int32 getPlayerTtl() const noexcept {
+            return m_playerTtlMillisec;
+        }
+
+        /// <summary>
+        /// 地域ごとの応答時間を計測して接続する地域を選ぶようにします。
+        /// </summary>
+        /// <remarks>
+        /// RegionSelectionMode::SELECT で初期化した場合のみ有効です。
+        /// 有効期限内の計測結果があれば計測を待たずにその地域へ接続し、計測はバックグラウンドで続けます。
+        /// </remarks>
+        /// <param name="cachePath">
+        /// 計測結果を保存するファイル
+        /// </param>
+        /// <param name="ttl">
+        /// 保存した計測結果の有効期限
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        SceneMaster& setRegionCache(const s3d::FilePath& cachePath, const s3d::Duration& ttl = s3d::Days(1)) {
+            m_regionSelector = std::make_unique<RegionSelector>(cachePath, ttl);
+            return *this;
+        }
+
+        [[nodiscard]] const RegionSelector* getRegionSelector() const noexcept {
+            return m_regionSelector.get();
+        }
+
+        /// <summary>
+        /// 最後に Connect() してから接続が完了するまでの時間を取得します。
+        /// </summary>
+        /// <returns>
+        /// 接続にかかった時間
+        /// </returns>
+        [[nodiscard]] const s3d::Duration& getConnectTime() const noexcept {
+            return m_connectTime;
+        }
+
+        /// <summary>
+        /// 通信環境を再現します。
+        /// </summary>
+        /// <remarks>
+        /// シーンに届くコールバックと、RaiseEvent() などの SceneMaster を通した操作が遅延・ロスなどの影響を受けます。
+        /// </remarks>
+        /// <param name="conditions">
+        /// 再現する通信環境
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        SceneMaster& setNetworkConditions(const NetworkConditions& conditions) {
+            m_networkSimulator.setConditions(conditions);
+            return *this;
+        }
+
+        /// <summary>
+        /// プリセットの通信環境を再現します。実行中に切り替えることもできます。
+        /// </summary>
+        /// <param name="preset">
+        /// プリセット
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        SceneMaster& setNetworkPreset(NetworkPreset preset) {
+            m_networkSimulator.setPreset(preset);
+            return *this;
+        }
+
+        /// <summary>
+        /// 通信環境の再現に使う乱数のシードを設定します。
+        /// </summary>
+        /// <param name="seed">
+        /// シード
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        SceneMaster& setNetworkSimulatorSeed(s3d::uint64 seed) {
+            m_networkSimulator.setSeed(seed);
+            return *this;
+        }
+
+        [[nodiscard]] NetworkSimulator& getNetworkSimulator() noexcept {
+            return m_networkSimulator;
+        }
+
+        /// <summary>
+        /// 部屋のもう1人のプレイヤーとロックステップを開始します。
+        /// </summary>
+        /// <remarks>
+        /// 入力は settings.eventCode のイベントで信頼性の無い通信で送られ、このイベントはシーンに届きません。
+        /// settings.eventCode には、イベントの圧縮が使う 199 と Photon が予約している 200 以上以外を指定してください。
+        /// 両方のプレイヤーが開始してから入力が揃い始めます。
+        /// </remarks>
+        /// <param name="settings">
+        /// 設定
+        /// </param>
+        /// <returns>
+        /// 開始できた場合 true, 部屋に自分ともう1人がいない場合は false
+        /// </returns>
+        bool StartLockstep(const LockstepSettings& settings = LockstepSettings()) {
+            const auto& players = m_loadBalancingClient.getCurrentlyJoinedRoom().getPlayers();
+
+            if (players.getSize() != 2) {
+                return false;
+            }
+
+            const int localPlayerNr = m_loadBalancingClient.getLocalPlayer().getNumber();
+
+            const int remotePlayerNr = (players[0]->getNumber() == localPlayerNr) ? players[1]->getNumber() : players[0]->getNumber();
+
+            m_lockstep = std::make_unique<LockstepEngine>(settings, localPlayerNr, remotePlayerNr);
+
+            m_networkSimulator.setEventReliable(settings.eventCode, false);
+
+            return true;
+        }
+
+        void StopLockstep() {
+            m_lockstep.reset();
+        }
+
+        [[nodiscard]] LockstepEngine* getLockstep() const noexcept {
+            return m_lockstep.get();
+        }
+
+        /// <summary>
+        /// 部屋の他のプレイヤーにイベントを送ります。
+        /// </summary>
+        /// <param name="reliable">
+        /// 信頼性のある通信で送るか
+        /// </param>
+        /// <param name="parameters">
+        /// 送る内容
+        /// </param>
+        /// <param name="eventCode">
+        /// イベントコード
+        /// </param>
+        /// <param name="options">
+        /// 送信先などのオプション
+        /// </param>
+        /// <returns>
+        /// なし
+        /// </returns>
+        template<class Ftype>
+        void RaiseEvent(bool reliable, const Ftype& parameters, nByte eventCode, const ExitGames::LoadBalancing::RaiseEventOptions& options = ExitGames::LoadBalancing::RaiseEventOptions()) {
+            if (m_eventCompressor.isEnabled()) {
+                if (const auto compressed = m_eventCompressor.compress(eventCode, parameters)) {
+                    sendEvent(reliable, *compressed, EventCompressor::EventCode, options);
+                    return;
+                }
+            }
+
+            sendEvent(reliable, parameters, eventCode, options);
+        }
+
+        /// <summary>
+        /// 大きいカスタムイベントの内容を圧縮して送るようにします。
+        /// </summary>
+        /// <remarks>
+        /// 圧縮されたイベントは受け取った側で展開され、元のイベントコードで CustomEventAction() などに届きます。
+        /// 圧縮を使う間はイベントコード 199（EventCompressor::EventCode）を予約するので、アプリのイベントには使わないでください。
+        /// ロックステップも LockstepSettings::eventCode（既定は 198）を使います。
+        /// 受け取る側も圧縮を有効にする必要があります。辞書を使う場合は、部屋の全てのプレイヤーが同じ辞書を設定してください。
+        /// </remarks>
+        /// <param name="threshold">
+        /// 圧縮するシリアライズ後の大きさ（バイト）。0 の場合は圧縮しません。
+        /// </param>
+        /// <param name="dictionary">
+        /// 圧縮に使う辞書
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        SceneMaster& setEventCompression(size_t threshold, s3d::Array<s3d::uint8> dictionary = {}) {
+            m_eventCompressor.setThreshold(threshold);
+            m_eventCompressor.setDictionary(std::move(dictionary));
+            return *this;
+        }
+
+        /// <summary>
+        /// イベントコードごとに、圧縮するかを設定します。
+        /// </summary>
+        /// <remarks>
+        /// 頻繁に送る小さいイベントを除いておくと、大きさを調べるためのシリアライズを省けます。
+        /// スカラーや固定長の型の配列は、シリアライズせずに大きさを見積もります。
+        /// </remarks>
+        /// <param name="eventCode">
+        /// イベントコード
+        /// </param>
+        /// <param name="compressible">
+        /// 圧縮するか
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        SceneMaster& setEventCompressible(nByte eventCode, bool compressible) {
+            m_eventCompressor.setEventCompressible(eventCode, compressible);
+            return *this;
+        }
+
+        /// <summary>
+        /// 圧縮率や圧縮・展開にかかった時間を取得します。
+        /// </summary>
+        [[nodiscard]] const EventCompressor::Stats& getEventCompressionStats() const noexcept {
+            return m_eventCompressor.getStats();
+        }
 
-            if (m_transitionState == TransitionState::FadeInOut) {
-                if (elapsed >= m_transitionTimeMillisec) {
-                    m_current = m_next;
+        /// <summary>
+        /// 部屋を作成します。
+        /// </summary>
+        void CreateRoom(const ExitGames::Common::JString& roomName, const ExitGames::LoadBalancing::RoomOptions& options) {
+            send(ControlMessageBytes, true, [this](const ExitGames::Common::JString& roomName_, const ExitGames::LoadBalancing::RoomOptions& options_) {
+                m_loadBalancingClient.opCreateRoom(roomName_, options_);
+            }, roomName, options);
+        }
 
-                    m_next = nullptr;
+        /// <summary>
+        /// 条件に合う部屋にランダムに参加します。
+        /// </summary>
+        void JoinRandomRoom(const ExitGames::Common::Hashtable& properties, nByte maxPlayers) {
+            send(ControlMessageBytes, true, [this](const ExitGames::Common::Hashtable& properties_, nByte maxPlayers_) {
+                m_loadBalancingClient.opJoinRandomRoom(properties_, maxPlayers_);
+            }, properties, maxPlayers);
+        }
 
-                    m_stopwatch.reset();
+        /// <summary>
+        /// 部屋に参加します。
+        /// </summary>
+        void JoinRoom(const ExitGames::Common::JString& roomName) {
+            send(ControlMessageBytes, true, [this](const ExitGames::Common::JString& roomName_) {
+                m_loadBalancingClient.opJoinRoom(roomName_);
+            }, roomName);
+        }
 
-                    m_transitionState = TransitionState::Active;
-                }
-            }
+        /// <summary>
+        /// ロビーの部屋の一覧の索引に使うカスタムプロパティを設定します。
+        /// </summary>
+        /// <remarks>
+        /// 同じ値を持つ部屋が1つのグループになり、getRoomIndex().findBestRoom() で入れる部屋を探せます。
+        /// </remarks>
+        /// <param name="propertyKey">
+        /// カスタムプロパティのキー
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        SceneMaster& setRoomIndexKey(const ExitGames::Common::JString& propertyKey) {
+            m_roomIndex.setPropertyKey(propertyKey);
+            return *this;
+        }
 
-            if (m_transitionState == TransitionState::Active) {
-                m_current->update();
+        [[nodiscard]] const RoomIndex& getRoomIndex() const noexcept {
+            return m_roomIndex;
+        }
 
-                return !hasError();
-            }
-            else {
-                assert(m_transitionTimeMillisec);
+        /// <summary>
+        /// シーンの更新・通信・ウィンドウが裏にある時のフレームレートを設定します。
+        /// </summary>
+        /// <remarks>
+        /// 通信は描画やシーンの更新とは別に数えるので、フレームレートを下げても設定した頻度を保ちます。
+        /// </remarks>
+        /// <param name="settings">
+        /// 設定
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        SceneMaster& setFrameRates(const FrameRateSettings& settings) {
+            m_frameScheduler.setSettings(settings);
+            return *this;
+        }
 
-                const double t = elapsed / m_transitionTimeMillisec;
+        /// <summary>
+        /// 直近1秒間のフレーム・更新・描画・通信の回数を取得します。
+        /// </summary>
+        [[nodiscard]] const FrameRateStats& getFrameRateStats() const noexcept {
+            return m_frameScheduler.getStats();
+        }
 
-                m_current->updateFadeOut(t);
+        [[nodiscard]] PropertyStore& getRoomProperties() noexcept {
+            return m_roomProperties;
+        }
 
-                if (hasError()) {
-                    return false;
-                }
+        [[nodiscard]] PropertyStore& getPlayerProperties(int playerNr) {
+            return m_playerProperties[playerNr];
+        }
 
-                m_next->updateFadeIn(t);
+        /// <summary>
+        /// 通信量と応答時間の記録を有効・無効にします。
+        /// </summary>
+        /// <remarks>
+        /// 有効にすると毎フレーム記録し、getTrafficMonitor() で記録の取得やグラフの表示、ファイルへの書き出しの設定ができます。
+        /// </remarks>
+        /// <param name="enabled">
+        /// 記録するか
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        SceneMaster& setTrafficStatsEnabled(bool enabled) {
+            m_loadBalancingClient.setTrafficStatsEnabled(enabled);
 
-                return !hasError();
+            if (!enabled) {
+                m_trafficMonitor.reset();
+            }
+            else if (!m_trafficMonitor) {
+                m_trafficMonitor = std::make_unique<TrafficMonitor>();
             }
-        }
 
-        [[nodiscard]] bool hasError() const noexcept {
-            return m_error;
+            return *this;
         }
 
-    public:
         /// <summary>
-        /// シーンのインタフェース
+        /// 通信量と応答時間の記録を取得します。
         /// </summary>
-        using Scene = IScene<State, Data>;
+        /// <returns>
+        /// 記録が無効な場合は nullptr
+        /// </returns>
+        [[nodiscard]] TrafficMonitor* getTrafficMonitor() noexcept {
+            return m_trafficMonitor.get();
+        }
 
         /// <summary>
-        /// シーン管理を初期化します。
+        /// 1フレームだけ使う一時的なアリーナを取得します。
         /// </summary>
-        /// <param name="option">
-        /// シーン管理のオプション
-        /// </param>
-        SceneMaster(const ExitGames::Common::JString& appID_, const ExitGames::Common::JString& appVersion_)
-        : m_data(s3d::MakeShared<Data>()), m_loadBalancingClient(*this, appID_, appVersion_), m_usePhoton(false) {}
+        /// <returns>
+        /// std::pmr のコンテナなどに渡す memory_resource
+        /// </returns>
+        [[nodiscard]] std::pmr::memory_resource* getFrameArena() noexcept {
+            return m_frameArena.resource();
+        }
 
         /// <summary>
-        /// シーン管理を初期化します。
+        /// 前のフレームで現在のシーンのアリーナから確保した回数とバイト数を取得します。
         /// </summary>
-        /// <param name="data">
-        /// 共有データ
-        /// </param>
-        /// <param name="option">
-        /// シーン管理のオプション
-        /// </param>
-        explicit SceneMaster(const std::shared_ptr<Data>& data, const ExitGames::Common::JString& appID_, const ExitGames::Common::JString& appVersion_)
-        : m_data(data), m_loadBalancingClient(*this, appID_, appVersion_), m_usePhoton(false) {}
-
-        ~SceneMaster() {
-            if (UsePhoton()) {
-                m_loadBalancingClient.disconnect();
-            }
+        /// <remarks>
+        /// アリーナを通さない確保は数えないので、heapAllocations が 0 でもフレーム中にヒープを使っていないとは限りません。
+        /// フレーム中の確保が無いことを確かめる場合は getGlobalAllocationStats() を使ってください。
+        /// </remarks>
+        /// <returns>
+        /// 確保の回数とバイト数
+        /// </returns>
+        [[nodiscard]] const AllocationStats& getSceneAllocationStats() const noexcept {
+            return m_sceneAllocationStats;
         }
 
-        bool UsePhoton() {
-            return m_usePhoton;
+        /// <summary>
+        /// 前のフレームで一時的なアリーナから確保した回数とバイト数を取得します。
+        /// </summary>
+        /// <returns>
+        /// 確保の回数とバイト数
+        /// </returns>
+        [[nodiscard]] const AllocationStats& getFrameAllocationStats() const noexcept {
+            return m_frameAllocationStats;
         }
-        void UsePhoton(const bool use_) {
-            m_usePhoton = use_;
+
+        /// <summary>
+        /// 前のフレームでプロセス全体の operator new を呼んだ回数とバイト数を取得します。
+        /// </summary>
+        /// <remarks>
+        /// PHOTONSAMPLE_COUNT_ALLOCATIONS を定義し、PHOTONSAMPLE_DEFINE_ALLOCATION_COUNTER() で operator new を置き換えた場合だけ数えます。
+        /// 他のスレッドの確保も含みます。
+        /// </remarks>
+        /// <returns>
+        /// 確保の回数とバイト数
+        /// </returns>
+        [[nodiscard]] const GlobalAllocationStats& getGlobalAllocationStats() const noexcept {
+            return m_globalAllocationStats;
         }
 
         /// <summary>
@@ -483,7 +1723,14 @@ namespace Utility {
         SceneMaster& add(const State& state) {
             typename Scene::InitData initData(state, m_data, this);
 
-            auto factory = [=]() { return std::make_shared<Scene>(initData); };
+            // アリーナはシーンを作るたびに新しく用意する
+            auto factory = [=]() {
+                typename Scene::InitData sceneInitData = initData;
+
+                sceneInitData._a = std::make_shared<SceneArena>();
+
+                return std::make_shared<Scene>(sceneInitData);
+            };
 
             auto it = m_factories.find(state);
 
@@ -501,6 +1748,25 @@ namespace Utility {
             return *this;
         }
 
+        /// <summary>
+        /// 追加したシーンを作ります。作ったシーンは現在のシーンにはなりません。
+        /// </summary>
+        /// <param name="state">
+        /// シーンのキー
+        /// </param>
+        /// <returns>
+        /// シーンが追加されていない場合は nullptr
+        /// </returns>
+        [[nodiscard]] std::shared_ptr<IScene<State, Data>> createScene(const State& state) {
+            auto it = m_factories.find(state);
+
+            if (it == m_factories.end()) {
+                return nullptr;
+            }
+
+            return it->second();
+        }
+
         /// <summary>
         /// 最初のシーンを初期化します。
         /// </summary>
@@ -547,6 +1813,14 @@ namespace Utility {
                 return false;
             }
 
+            beginFrameArena();
+
+            m_frameScheduler.beginFrame();
+
+            if (m_trafficMonitor && UsePhoton()) {
+                m_trafficMonitor->sample(m_loadBalancingClient);
+            }
+
             if (!m_current) {
                 if (!m_first) {
                     return true;
@@ -556,12 +1830,22 @@ namespace Utility {
                 }
             }
 
-            if (m_crossFade) {
-                return updateCross();
-            }
-            else {
-                return updateSingle();
-            }
+            updateReconnect();
+
+            updateRegionSelector();
+
+            updatePreConnect();
+
+            m_networkSimulator.update();
+
+            // シーンが追加した入力をこのフレームのうちに送る
+            const bool result = m_crossFade ? updateCross() : updateSingle();
+
+            sendLockstepInputs();
+
+            flushProperties();
+
+            return result;
         }
 
         /// <summary>
@@ -607,7 +1891,16 @@ namespace Utility {
                 return false;
             }
 
-            drawScene();
+            // 最小化している間は描画しない
+            if (m_frameScheduler.isDrawDue()) {
+                drawScene();
+
+                if (m_trafficMonitor) {
+                    m_trafficMonitor->draw();
+                }
+            }
+
+            m_frameScheduler.endFrame();
 
             return true;
         }
@@ -729,55 +2022,212 @@ namespace Utility {
 
     private:
         virtual void debugReturn(int debugLevel, const ExitGames::Common::JString& string) override {
+            // 量が多いので、画面に出さずにログにだけ書く。レベルごとに分けて、コンパイル時に取り除けるようにする
+            switch (ToLogLevel(debugLevel)) {
+            case LogLevel::Error:
+                PHOTONSAMPLE_LOG(LogLevel::Error, string);
+                break;
+            case LogLevel::Warning:
+                PHOTONSAMPLE_LOG(LogLevel::Warning, string);
+                break;
+            case LogLevel::Info:
+                PHOTONSAMPLE_LOG(LogLevel::Info, string);
+                break;
+            default:
+                PHOTONSAMPLE_LOG(LogLevel::Trace, string);
+                break;
+            }
+
             if (m_current) {
                 m_current->DebugReturn(debugLevel, string);
             }
         }
 
         virtual void connectionErrorReturn(int errorCode) override {
+            PHOTONSAMPLE_LOG(LogLevel::Error, U"connectionErrorReturn", LogField(U"errorCode", errorCode));
+
+            // 再接続中のエラーは続く disconnectReturn でまとめて扱う
+            if (isReconnecting()) {
+                return;
+            }
+
             m_current->ConnectionErrorReturn(errorCode);
         }
 
         virtual void clientErrorReturn(int errorCode) override {
+            PHOTONSAMPLE_LOG(LogLevel::Error, U"clientErrorReturn", LogField(U"errorCode", errorCode));
+
             if (m_current) {
                 m_current->ClientErrorReturn(errorCode);
             }
         }
 
         virtual void warningReturn(int warningCode) override {
+            PHOTONSAMPLE_LOG(LogLevel::Warning, U"warningReturn", LogField(U"warningCode", warningCode));
+
             m_current->WarningReturn(warningCode);
         }
 
         virtual void serverErrorReturn(int errorCode) override {
+            PHOTONSAMPLE_LOG(LogLevel::Error, U"serverErrorReturn", LogField(U"errorCode", errorCode));
+
             m_current->ServerErrorReturn(errorCode);
         }
 
         virtual void joinRoomEventAction(int playerNr, const ExitGames::Common::JVector<int>& playernrs, const ExitGames::LoadBalancing::Player& player) override {
-            m_current->JoinRoomEventAction(playerNr, playernrs, player);
+            PHOTONSAMPLE_LOG(LogLevel::Info, U"joinRoomEventAction", LogField(U"playerNr", playerNr), LogField(U"players", playernrs.getSize()));
+
+            receive(ControlMessageBytes, true, [this](int playerNr_, const ExitGames::Common::JVector<int>& playernrs_, const ExitGames::LoadBalancing::Player& player_) {
+                m_current->JoinRoomEventAction(playerNr_, playernrs_, player_);
+            }, playerNr, playernrs, player);
         }
 
         virtual void leaveRoomEventAction(int playerNr, bool isInactive) override {
-            m_current->LeaveRoomEventAction(playerNr, isInactive);
+            PHOTONSAMPLE_LOG(LogLevel::Info, U"leaveRoomEventAction", LogField(U"playerNr", playerNr), LogField(U"isInactive", isInactive));
+
+            receive(ControlMessageBytes, true, [this](int playerNr_, bool isInactive_) {
+                // 戻ってくる可能性がある間はプロパティを残す
+                if (!isInactive_) {
+                    m_playerProperties.erase(playerNr_);
+                }
+
+                m_current->LeaveRoomEventAction(playerNr_, isInactive_);
+            }, playerNr, isInactive);
         }
 
         virtual void customEventAction(int playerNr, nByte eventCode, const ExitGames::Common::Object& eventContent) override {
-            m_current->CustomEventAction(playerNr, eventCode, eventContent);
+            PHOTONSAMPLE_LOG(LogLevel::Trace, U"customEventAction", LogField(U"playerNr", playerNr), LogField(U"eventCode", eventCode));
+
+            receive(payloadSize(eventContent), m_networkSimulator.isEventReliable(eventCode), [this](int playerNr_, nByte eventCode_, const ExitGames::Common::Object& eventContent_) {
+                dispatchCustomEvent(playerNr_, eventCode_, eventContent_);
+            }, playerNr, eventCode, eventContent);
         }
 
         virtual void connectReturn(int errorCode,
                                    const ExitGames::Common::JString& errorString,
                                    const ExitGames::Common::JString& region,
                                    const ExitGames::Common::JString& cluster) override {
-            m_current->ConnectReturn(errorCode, errorString, region, cluster);
+            PHOTONSAMPLE_LOG(LogLevel::Info, U"connectReturn", LogField(U"errorCode", errorCode));
+
+            if (!errorCode) {
+                m_connectedRegion = region;
+
+                m_connectedCluster = cluster;
+            }
+
+            if (m_preConnectState == PreConnectState::Connecting) {
+                // 失敗した場合は続く disconnectReturn で後始末をする
+                if (!errorCode) {
+                    m_preConnectState = PreConnectState::Ready;
+
+                    m_preConnectStopwatch.restart();
+                }
+                return;
+            }
+
+            if (m_reconnectState == ReconnectState::Connecting) {
+                // 失敗した場合は続く disconnectReturn で次の再接続が予約される
+                if (!errorCode) {
+                    m_loadBalancingClient.opJoinRoom(m_roomName, true);
+
+                    m_reconnectState = ReconnectState::Rejoining;
+                }
+                return;
+            }
+
+            if (isReconnecting()) {
+                return;
+            }
+
+            // 再接続の接続は Connect() からの時間ではないので記録しない
+            if (!errorCode) {
+                m_connectTime = m_connectStopwatch.elapsed();
+            }
+
+            receive(ControlMessageBytes, true, [this](int errorCode_, const ExitGames::Common::JString& errorString_, const ExitGames::Common::JString& region_, const ExitGames::Common::JString& cluster_) {
+                m_current->ConnectReturn(errorCode_, errorString_, region_, cluster_);
+            }, errorCode, errorString, region, cluster);
+        }
+
+        virtual void onAvailableRegions(const ExitGames::Common::JVector<ExitGames::Common::JString>& availableRegions,
+                                        const ExitGames::Common::JVector<ExitGames::Common::JString>& availableRegionServers) override {
+            m_regionSelected = false;
+
+            m_availableRegions.clear();
+
+            for (unsigned int i = 0; i < availableRegions.getSize(); ++i) {
+                m_availableRegions.push_back(availableRegions[i]);
+            }
+
+            if (!m_regionSelector) {
+                selectRegion(m_availableRegions.front());
+                return;
+            }
+
+            // 有効なキャッシュがあれば計測の完了を待たずに接続する
+            if (const auto cached = m_regionSelector->start(availableRegions, availableRegionServers)) {
+                selectRegion(ConvertStringToJString(*cached));
+            }
+            else if (!m_regionSelector->isMeasuring()) {
+                selectRegion(m_availableRegions.front());
+            }
         }
 
         virtual void disconnectReturn() override {
-            m_current->DisconnectReturn();
+            PHOTONSAMPLE_LOG(LogLevel::Info, U"disconnectReturn", LogField(U"requested", m_disconnectRequested));
+
             m_usePhoton = false;
+
+            m_roomIndex.clear();
+
+            // 先に接続しておいた接続はシーンが使っていないので通知しない
+            if (m_preConnectState != PreConnectState::None) {
+                m_preConnectState = PreConnectState::None;
+
+                if (m_connectAfterClose) {
+                    m_connectAfterClose = false;
+
+                    Connect();
+                }
+                return;
+            }
+
+            if (isReconnecting()) {
+                scheduleReconnect();
+                return;
+            }
+
+            // 部屋にいる時に予期せず切断された場合は、シーンを維持したまま再接続を試みる
+            if (!m_disconnectRequested && m_roomName.length() && m_maxReconnectAttempts > 0) {
+                m_reconnectAttempt = 0;
+
+                m_recoveryStopwatch.restart();
+
+                scheduleReconnect();
+                return;
+            }
+
+            m_disconnectRequested = false;
+
+            m_roomName = L"";
+
+            clearProperties();
+
+            receive(ControlMessageBytes, true, [this]() {
+                m_current->DisconnectReturn();
+            });
         }
 
         virtual void leaveRoomReturn(int errorCode, const ExitGames::Common::JString& errorString) override {
-            m_current->LeaveRoomReturn(errorCode, errorString);
+            PHOTONSAMPLE_LOG(LogLevel::Info, U"leaveRoomReturn", LogField(U"errorCode", errorCode));
+
+            m_roomName = L"";
+
+            clearProperties();
+
+            receive(ControlMessageBytes, true, [this](int errorCode_, const ExitGames::Common::JString& errorString_) {
+                m_current->LeaveRoomReturn(errorCode_, errorString_);
+            }, errorCode, errorString);
         }
 
         virtual void createRoomReturn(int localPlayerNr,
@@ -785,7 +2235,21 @@ namespace Utility {
                                       const ExitGames::Common::Hashtable& playerProperties,
                                       int errorCode,
                                       const ExitGames::Common::JString& errorString) override {
-            m_current->CreateRoomReturn(localPlayerNr, roomProperties, playerProperties, errorCode, errorString);
+            PHOTONSAMPLE_LOG(LogLevel::Info, U"createRoomReturn", LogField(U"localPlayerNr", localPlayerNr), LogField(U"errorCode", errorCode));
+
+            if (!errorCode) {
+                m_roomName = m_loadBalancingClient.getCurrentlyJoinedRoom().getName();
+
+                loadProperties();
+            }
+
+            receive(payloadSize(roomProperties), true, [this](int localPlayerNr_,
+                                                             const ExitGames::Common::Hashtable& roomProperties_,
+                                                             const ExitGames::Common::Hashtable& playerProperties_,
+                                                             int errorCode_,
+                                                             const ExitGames::Common::JString& errorString_) {
+                m_current->CreateRoomReturn(localPlayerNr_, roomProperties_, playerProperties_, errorCode_, errorString_);
+            }, localPlayerNr, roomProperties, playerProperties, errorCode, errorString);
         }
 
         virtual void joinRandomRoomReturn(int localPlayerNr,
@@ -793,7 +2257,91 @@ namespace Utility {
                                           const ExitGames::Common::Hashtable& playerProperties,
                                           int errorCode,
                                           const ExitGames::Common::JString& errorString) override {
-            m_current->JoinRandomRoomReturn(localPlayerNr, roomProperties, playerProperties, errorCode, errorString);
+            PHOTONSAMPLE_LOG(LogLevel::Info, U"joinRandomRoomReturn", LogField(U"localPlayerNr", localPlayerNr), LogField(U"errorCode", errorCode));
+
+            if (!errorCode) {
+                m_roomName = m_loadBalancingClient.getCurrentlyJoinedRoom().getName();
+
+                loadProperties();
+            }
+
+            receive(payloadSize(roomProperties), true, [this](int localPlayerNr_,
+                                                             const ExitGames::Common::Hashtable& roomProperties_,
+                                                             const ExitGames::Common::Hashtable& playerProperties_,
+                                                             int errorCode_,
+                                                             const ExitGames::Common::JString& errorString_) {
+                m_current->JoinRandomRoomReturn(localPlayerNr_, roomProperties_, playerProperties_, errorCode_, errorString_);
+            }, localPlayerNr, roomProperties, playerProperties, errorCode, errorString);
+        }
+
+        virtual void onRoomListUpdate() override {
+            PHOTONSAMPLE_LOG(LogLevel::Debug, U"onRoomListUpdate", LogField(U"rooms", m_loadBalancingClient.getRoomList().getSize()));
+
+            // 索引はすぐに更新し、シーンへの通知だけ遅らせる
+            if (!m_roomIndex.update(m_loadBalancingClient.getRoomList())) {
+                return;
+            }
+
+            receive(ControlMessageBytes, true, [this]() {
+                m_current->RoomListUpdateAction();
+            });
+        }
+
+        virtual void onRoomPropertiesChange(const ExitGames::Common::Hashtable& changes) override {
+            PHOTONSAMPLE_LOG(LogLevel::Debug, U"onRoomPropertiesChange", LogField(U"keys", changes.getSize()));
+
+            receive(payloadSize(changes), true, [this](const ExitGames::Common::Hashtable& changes_) {
+                m_roomProperties.apply(changes_);
+
+                m_current->RoomPropertiesChangeAction(changes_);
+            }, changes);
+        }
+
+        virtual void onPlayerPropertiesChange(int playerNr, const ExitGames::Common::Hashtable& changes) override {
+            PHOTONSAMPLE_LOG(LogLevel::Debug, U"onPlayerPropertiesChange", LogField(U"playerNr", playerNr), LogField(U"keys", changes.getSize()));
+
+            receive(payloadSize(changes), true, [this](int playerNr_, const ExitGames::Common::Hashtable& changes_) {
+                m_playerProperties[playerNr_].apply(changes_);
+
+                m_current->PlayerPropertiesChangeAction(playerNr_, changes_);
+            }, playerNr, changes);
+        }
+
+        virtual void joinRoomReturn(int localPlayerNr,
+                                    const ExitGames::Common::Hashtable& roomProperties,
+                                    const ExitGames::Common::Hashtable& playerProperties,
+                                    int errorCode,
+                                    const ExitGames::Common::JString& errorString) override {
+            PHOTONSAMPLE_LOG(LogLevel::Info, U"joinRoomReturn", LogField(U"localPlayerNr", localPlayerNr), LogField(U"errorCode", errorCode));
+
+            if (m_reconnectState == ReconnectState::Rejoining) {
+                // 切断していた間の変更を読み直す
+                if (!errorCode) {
+                    loadProperties();
+                }
+
+                finishReconnect(errorCode);
+
+                // 部屋が既に無い場合などは戻れないので、通常の切断として扱う
+                if (errorCode) {
+                    Disconnect();
+                }
+                return;
+            }
+
+            if (!errorCode) {
+                m_roomName = m_loadBalancingClient.getCurrentlyJoinedRoom().getName();
+
+                loadProperties();
+            }
+
+            receive(payloadSize(roomProperties), true, [this](int localPlayerNr_,
+                                                             const ExitGames::Common::Hashtable& roomProperties_,
+                                                             const ExitGames::Common::Hashtable& playerProperties_,
+                                                             int errorCode_,
+                                                             const ExitGames::Common::JString& errorString_) {
+                m_current->JoinRoomReturn(localPlayerNr_, roomProperties_, playerProperties_, errorCode_, errorString_);
+            }, localPlayerNr, roomProperties, playerProperties, errorCode, errorString);
         }
     };
 }  // namespace shogi
@@ -0,0 +1,289 @@
+﻿#pragma once
+#define NO_S3D_USING
+#include <Siv3D.hpp>  // OpenSiv3D v0.4.3
+#include <LoadBalancing-cpp/inc/Client.h>
+#include <filesystem>
+
+namespace Utility {
+    /// <summary>
+    /// ある時点の通信量と応答時間
+    /// </summary>
+    struct TrafficSample {
+        // 計測を始めてからの時間（秒）
+        double time = 0.0;
+
+        // 以下の通信量は接続してからの累計
+        s3d::int64 bytesIn = 0;
+
+        s3d::int64 bytesOut = 0;
+
+        s3d::int64 packetsIn = 0;
+
+        s3d::int64 packetsOut = 0;
+
+        s3d::int64 resentReliableCommands = 0;
+
+        s3d::int32 roundTripTime = 0;
+
+        s3d::int32 roundTripTimeVariance = 0;
+    };
+
+    /// <summary>
+    /// 通信量と応答時間を記録し、グラフの表示とファイルへの書き出しを行う
+    /// </summary>
+    /// <remarks>
+    /// 記録は固定長のリングバッファに行い、古いものから上書きされます。
+    /// </remarks>
+    class TrafficMonitor : s3d::Uncopyable {
+    public:
+        static constexpr size_t Capacity = 600;
+
+        enum class ExportFormat {
+            Prometheus,  // Prometheus のテキスト形式（node_exporter の textfile collector などで収集できる）
+
+            JSON,
+        };
+
+    private:
+        std::array<TrafficSample, Capacity> m_samples;
+
+        size_t m_head = 0;
+
+        size_t m_size = 0;
+
+        s3d::Stopwatch m_stopwatch{ true };
+
+        bool m_overlayVisible = false;
+
+        s3d::Font m_font{ 14 };
+
+        s3d::FilePath m_exportPath;
+
+        ExportFormat m_exportFormat = ExportFormat::Prometheus;
+
+        double m_exportIntervalSec = 0.0;
+
+        double m_lastExportTime = 0.0;
+
+        void writePrometheus(s3d::TextWriter& writer, const TrafficSample& sample) const {
+            const auto metric = [&](const s3d::StringView name, const s3d::StringView type, const s3d::StringView help, const auto value) {
+                writer.writeln(U"# HELP ", name, U' ', help);
+                writer.writeln(U"# TYPE ", name, U' ', type);
+                writer.writeln(name, U' ', value);
+            };
+
+            metric(U"photon_received_bytes_total", U"counter", U"Bytes received since connecting.", sample.bytesIn);
+            metric(U"photon_sent_bytes_total", U"counter", U"Bytes sent since connecting.", sample.bytesOut);
+            metric(U"photon_received_packets_total", U"counter", U"Packets received since connecting.", sample.packetsIn);
+            metric(U"photon_sent_packets_total", U"counter", U"Packets sent since connecting.", sample.packetsOut);
+            metric(U"photon_resent_reliable_commands_total", U"counter", U"Reliable commands that had to be resent.", sample.resentReliableCommands);
+            metric(U"photon_round_trip_time_milliseconds", U"gauge", U"Smoothed round trip time.", sample.roundTripTime);
+            metric(U"photon_round_trip_time_variance_milliseconds", U"gauge", U"Variance of the round trip time.", sample.roundTripTimeVariance);
+        }
+
+        void writeJSON(s3d::TextWriter& writer, const TrafficSample& sample) const {
+            writer.writeln(U"{");
+            writer.writeln(U"  \"time\": ", sample.time, U',');
+            writer.writeln(U"  \"bytesIn\": ", sample.bytesIn, U',');
+            writer.writeln(U"  \"bytesOut\": ", sample.bytesOut, U',');
+            writer.writeln(U"  \"packetsIn\": ", sample.packetsIn, U',');
+            writer.writeln(U"  \"packetsOut\": ", sample.packetsOut, U',');
+            writer.writeln(U"  \"resentReliableCommands\": ", sample.resentReliableCommands, U',');
+            writer.writeln(U"  \"roundTripTime\": ", sample.roundTripTime, U',');
+            writer.writeln(U"  \"roundTripTimeVariance\": ", sample.roundTripTimeVariance);
+            writer.writeln(U"}");
+        }
+
+        /// <summary>
+        /// 値の推移を折れ線で描く
+        /// </summary>
+        template<class Getter>
+        void drawGraph(const s3d::RectF& area, const s3d::ColorF& color, Getter getter) const {
+            double maxValue = 1.0;
+
+            for (size_t i = 0; i < m_size; ++i) {
+                maxValue = s3d::Max(maxValue, getter(i));
+            }
+
+            s3d::LineString line(m_size);
+
+            for (size_t i = 0; i < m_size; ++i) {
+                line[i] = s3d::Vec2(area.x + area.w * i / (Capacity - 1), area.bottomY() - area.h * getter(i) / maxValue);
+            }
+
+            line.draw(1.5, color);
+        }
+
+    public:
+        /// <summary>
+        /// 現在の通信量と応答時間を記録します。
+        /// </summary>
+        /// <param name="client">
+        /// 記録するクライアント
+        /// </param>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void sample(ExitGames::LoadBalancing::Client& client) {
+            TrafficSample& sample = m_samples[(m_head + m_size) % Capacity];
+
+            if (m_size < Capacity) {
+                ++m_size;
+            }
+            else {
+                m_head = (m_head + 1) % Capacity;
+            }
+
+            sample.time = m_stopwatch.sF();
+            sample.bytesIn = client.getBytesIn();
+            sample.bytesOut = client.getBytesOut();
+            sample.packetsIn = client.getTrafficStatsIncoming().getTotalPacketCount();
+            sample.packetsOut = client.getTrafficStatsOutgoing().getTotalPacketCount();
+            sample.resentReliableCommands = client.getResentReliableCommands();
+            sample.roundTripTime = client.getRoundTripTime();
+            sample.roundTripTimeVariance = client.getRoundTripTimeVariance();
+
+            if (!m_exportPath.isEmpty() && m_exportIntervalSec > 0.0 && sample.time - m_lastExportTime >= m_exportIntervalSec) {
+                m_lastExportTime = sample.time;
+
+                exportTo(m_exportPath, m_exportFormat);
+            }
+        }
+
+        /// <summary>
+        /// 記録の数を取得します。
+        /// </summary>
+        [[nodiscard]] size_t size() const noexcept {
+            return m_size;
+        }
+
+        /// <summary>
+        /// 記録を古い順に取得します。
+        /// </summary>
+        /// <param name="index">
+        /// 0 が最も古い記録
+        /// </param>
+        [[nodiscard]] const TrafficSample& operator[](size_t index) const {
+            return m_samples[(m_head + index) % Capacity];
+        }
+
+        /// <summary>
+        /// 最新の記録を取得します。
+        /// </summary>
+        /// <returns>
+        /// 記録が無い場合は none
+        /// </returns>
+        [[nodiscard]] s3d::Optional<TrafficSample> latest() const {
+            if (!m_size) {
+                return s3d::none;
+            }
+
+            return (*this)[m_size - 1];
+        }
+
+        TrafficMonitor& setOverlayVisible(bool visible) noexcept {
+            m_overlayVisible = visible;
+            return *this;
+        }
+
+        [[nodiscard]] bool isOverlayVisible() const noexcept {
+            return m_overlayVisible;
+        }
+
+        /// <summary>
+        /// 最新の記録を一定間隔でファイルに書き出すようにします。
+        /// </summary>
+        /// <param name="path">
+        /// 書き出すファイル
+        /// </param>
+        /// <param name="interval">
+        /// 書き出す間隔
+        /// </param>
+        /// <param name="format">
+        /// 書き出す形式
+        /// </param>
+        /// <returns>
+        /// *this
+        /// </returns>
+        TrafficMonitor& setExport(const s3d::FilePath& path, const s3d::Duration& interval = s3d::SecondsF(5), ExportFormat format = ExportFormat::Prometheus) {
+            m_exportPath = path;
+            m_exportIntervalSec = interval.count();
+            m_exportFormat = format;
+            return *this;
+        }
+
+        /// <summary>
+        /// 最新の記録をファイルに書き出します。
+        /// </summary>
+        /// <remarks>
+        /// 収集する側が書きかけのファイルを読まないよう、一時ファイルに書いてから置き換えます。
+        /// </remarks>
+        /// <param name="path">
+        /// 書き出すファイル
+        /// </param>
+        /// <param name="format">
+        /// 書き出す形式
+        /// </param>
+        /// <returns>
+        /// 書き出せた場合 true, それ以外の場合は false
+        /// </returns>
+        bool exportTo(const s3d::FilePath& path, ExportFormat format) const {
+            const auto sample = latest();
+
+            if (!sample) {
+                return false;
+            }
+
+            const s3d::FilePath temporaryPath = path + U".tmp";
+
+            {
+                s3d::TextWriter writer(temporaryPath);
+
+                if (!writer) {
+                    return false;
+                }
+
+                if (format == ExportFormat::Prometheus) {
+                    writePrometheus(writer, *sample);
+                }
+                else {
+                    writeJSON(writer, *sample);
+                }
+            }
+
+            std::error_code error;
+
+            std::filesystem::rename(temporaryPath.toWstr(), path.toWstr(), error);
+
+            return !error;
+        }
+
+        /// <summary>
+        /// 応答時間と通信量のグラフを描画します。
+        /// </summary>
+        /// <returns>
+        /// なし
+        /// </returns>
+        void draw() const {
+            if (!m_overlayVisible || m_size < 2) {
+                return;
+            }
+
+            const s3d::RectF area(10, 10, 320, 120);
+
+            area.draw(s3d::ColorF(0.0, 0.6));
+
+            // 応答時間(ミリ秒)
+            drawGraph(area, s3d::Palette::Orange, [this](size_t i) { return static_cast<double>((*this)[i].roundTripTime); });
+
+            // 前の記録からの受信量と送信量(バイト)
+            drawGraph(area, s3d::Palette::Skyblue, [this](size_t i) { return i ? static_cast<double>((*this)[i].bytesIn - (*this)[i - 1].bytesIn) : 0.0; });
+            drawGraph(area, s3d::Palette::Lightgreen, [this](size_t i) { return i ? static_cast<double>((*this)[i].bytesOut - (*this)[i - 1].bytesOut) : 0.0; });
+
+            const TrafficSample& last = (*this)[m_size - 1];
+
+            m_font(U"RTT ", last.roundTripTime, U"ms  in ", last.bytesIn, U"B  out ", last.bytesOut, U"B  resent ", last.resentReliableCommands)
+                .draw(area.bl().movedBy(0, 2), s3d::Palette::White);
+        }
+    };
+}  // namespace Utility